@@ -36,6 +36,13 @@
     #endif // __BYTE_ORDER__
 #endif // PARSER_ENDIAN
 
+// Hot path counters, compiled out unless built with -DPARSER_STATS=ON
+#ifdef FLVPARSER_ENABLE_STATS
+    #define FLVPARSER_STATS(...) __VA_ARGS__
+#else
+    #define FLVPARSER_STATS(...)
+#endif // FLVPARSER_ENABLE_STATS
+
 #define FLVPARSER_NAMESPACE_BEGIN namespace flvparser {
 #define FLVPARSER_NAMESPACE_END   }
 
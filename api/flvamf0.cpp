@@ -0,0 +1,296 @@
+/**
+* This file is part of FLVParser.
+
+* FLVParser is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+
+* FLVParser is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+
+* You should have received a copy of the GNU General Public License
+* along with FLVParser.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "common.h"
+#include "flvamf0.h"
+
+#include <string.h>
+
+FLVPARSER_NAMESPACE_BEGIN
+
+// nesting deeper than this is treated as malformed
+static const int kAmf0MaxDepth = 32;
+
+static bool ReadNumberArray(Amf0Reader& reader, size_t size, std::vector<double>& values)
+{
+    uint8_t type;
+    uint32_t count;
+    if (!reader.ReadType(type) || type != STRICT_ARRAY || !reader.ReadArrayCount(count))
+        return false;
+    // every number takes 9 bytes, a larger count is malformed
+    if (count > size / 9)
+        return false;
+    values.resize(count);
+    for (uint32_t idx = 0; idx < count; idx++)
+    {
+        if (!reader.ReadType(type) || type != DOUBLE || !reader.ReadNumber(values[idx]))
+            return false;
+    }
+    return true;
+}
+
+bool FindKeyframeIndex(const void* data, size_t size,
+                       std::vector<double>& times, std::vector<double>& positions)
+{
+    times.clear();
+    positions.clear();
+    Amf0Reader reader(data, size);
+    if (!reader.EnterScriptObject("onMetaData"))
+        return false;
+    const char* name;
+    uint16_t length;
+    while (reader.NextKey(name, length))
+    {
+        if (!Amf0KeyIs(name, length, "keyframes"))
+        {
+            if (!reader.SkipValue())
+                return false;
+            continue;
+        }
+        uint8_t type;
+        uint32_t count;
+        if (!reader.ReadType(type) || (type != OBJECT && type != ECMA_ARRAY) ||
+            (type == ECMA_ARRAY && !reader.ReadArrayCount(count)))
+            return false;
+        while (reader.NextKey(name, length))
+        {
+            bool bOk;
+            if (Amf0KeyIs(name, length, "times"))
+                bOk = ReadNumberArray(reader, size, times);
+            else if (Amf0KeyIs(name, length, "filepositions"))
+                bOk = ReadNumberArray(reader, size, positions);
+            else
+                bOk = reader.SkipValue();
+            if (!bOk)
+                return false;
+        }
+        return !times.empty() && times.size() == positions.size();
+    }
+    return false;
+}
+
+double ReadAmf0Double(const uint8_t* bytes)
+{
+    uint64_t bits = 0;
+    for (int idx = 0; idx < 8; idx++)
+        bits = (bits << 8) | bytes[idx];
+    double value;
+    memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+void WriteAmf0Double(uint8_t* bytes, double value)
+{
+    uint64_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    for (int idx = 7; idx >= 0; idx--)
+    {
+        bytes[idx] = (uint8_t)bits;
+        bits >>= 8;
+    }
+}
+
+bool Amf0Reader::ReadType(uint8_t& type)
+{
+    if (_offset + 1 > _size)
+        return false;
+    type = _data[_offset++];
+    return true;
+}
+
+bool Amf0Reader::PeekType(uint8_t& type) const
+{
+    if (_offset + 1 > _size)
+        return false;
+    type = _data[_offset];
+    return true;
+}
+
+bool Amf0Reader::ReadNumber(double& value)
+{
+    if (_offset + 8 > _size)
+        return false;
+    value = ReadAmf0Double(_data + _offset);
+    _offset += 8;
+    return true;
+}
+
+bool Amf0Reader::ReadShortString(const char*& text, uint16_t& length)
+{
+    if (_offset + 2 > _size)
+        return false;
+    length = (_data[_offset] << 8) | _data[_offset + 1];
+    if (_offset + 2 + length > _size)
+        return false;
+    text = (const char*)_data + _offset + 2;
+    _offset += 2 + length;
+    return true;
+}
+
+bool Amf0Reader::ReadArrayCount(uint32_t& count)
+{
+    if (_offset + 4 > _size)
+        return false;
+    const uint8_t* p = _data + _offset;
+    count = ((uint32_t)p[0] << 24) | (p[1] << 16) | (p[2] << 8) | p[3];
+    _offset += 4;
+    return true;
+}
+
+bool Amf0Reader::SkipValue()
+{
+    return SkipValue(0);
+}
+
+bool Amf0Reader::SkipProperties(int depth)
+{
+    const char* key;
+    uint16_t length;
+    while (true)
+    {
+        if (!ReadShortString(key, length))
+            return false;
+        if (length == 0 && _offset < _size && _data[_offset] == OBJECT_END_MARKER)
+        {
+            _offset++;
+            return true;
+        }
+        if (!SkipValue(depth + 1))
+            return false;
+    }
+}
+
+bool Amf0Reader::SkipValue(int depth)
+{
+    uint8_t type;
+    if (depth > kAmf0MaxDepth || !ReadType(type))
+        return false;
+    size_t skip = 0;
+    switch (type)
+    {
+    case DOUBLE:
+        skip = 8;
+        break;
+    case BOOLEAN:
+        skip = 1;
+        break;
+    case STRING:
+    {
+        const char* text;
+        uint16_t length;
+        return ReadShortString(text, length);
+    }
+    case OBJECT:
+        return SkipProperties(depth);
+    case NULL_DATA:
+    case UNDEFINED:
+        return true;
+    case REFERENCE:
+        skip = 2;
+        break;
+    case ECMA_ARRAY:
+    {
+        // the count is only a hint, the end marker terminates the array
+        uint32_t count;
+        return ReadArrayCount(count) && SkipProperties(depth);
+    }
+    case STRICT_ARRAY:
+    {
+        uint32_t count;
+        if (!ReadArrayCount(count))
+            return false;
+        for (uint32_t idx = 0; idx < count; idx++)
+        {
+            if (!SkipValue(depth + 1))
+                return false;
+        }
+        return true;
+    }
+    case DATA_DATE:
+        skip = 10;
+        break;
+    case LONG_STRING:
+    {
+        uint32_t length;
+        if (!ReadArrayCount(length))
+            return false;
+        skip = length;
+        break;
+    }
+    default:
+        return false;
+    }
+    if (_offset + skip > _size)
+        return false;
+    _offset += skip;
+    return true;
+}
+
+bool Amf0Reader::EnterScriptObject(const char* name)
+{
+    uint8_t type;
+    const char* text;
+    uint16_t length;
+    if (!ReadType(type) || type != STRING || !ReadShortString(text, length) ||
+        !Amf0KeyIs(text, length, name))
+        return false;
+    if (!ReadType(type))
+        return false;
+    if (type == ECMA_ARRAY)
+    {
+        uint32_t count;
+        return ReadArrayCount(count);
+    }
+    return type == OBJECT;
+}
+
+bool Amf0Reader::NextKey(const char*& key, uint16_t& length)
+{
+    if (!ReadShortString(key, length))
+        return false;
+    if (length == 0 && _offset < _size && _data[_offset] == OBJECT_END_MARKER)
+    {
+        _offset++;
+        return false;
+    }
+    return true;
+}
+
+bool FindMetadataNumber(const void* data, size_t size, const char* key, size_t& offset)
+{
+    Amf0Reader reader(data, size);
+    if (!reader.EnterScriptObject("onMetaData"))
+        return false;
+    const char* name;
+    uint16_t length;
+    while (reader.NextKey(name, length))
+    {
+        if (Amf0KeyIs(name, length, key))
+        {
+            uint8_t type;
+            if (!reader.ReadType(type) || type != DOUBLE || reader.Offset() + 8 > size)
+                return false;
+            offset = reader.Offset();
+            return true;
+        }
+        if (!reader.SkipValue())
+            return false;
+    }
+    return false;
+}
+
+FLVPARSER_NAMESPACE_END
@@ -0,0 +1,84 @@
+/**
+* This file is part of FLVParser.
+
+* FLVParser is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+
+* FLVParser is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+
+* You should have received a copy of the GNU General Public License
+* along with FLVParser.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef FLVAMF0_H_
+#define FLVAMF0_H_
+
+#include "common.h"
+#include "flvparser.h"
+
+#include <stddef.h>
+#include <string.h>
+#include <vector>
+
+FLVPARSER_NAMESPACE_BEGIN
+
+// Bounds checked walker over AMF0 script data. Nothing is allocated, keys
+// point into the data and skipped values are only stepped over. Every read
+// returns false on truncated or malformed data.
+class Amf0Reader
+{
+public:
+    Amf0Reader(const void* data, size_t size)
+        : _data(static_cast<const uint8_t*>(data)), _size(size) {}
+
+    size_t              Offset() const      { return _offset; }
+    bool                AtEnd() const       { return _offset >= _size; }
+
+    //! The ScriptDataType marker in front of every value
+    bool                ReadType(uint8_t& type);
+    bool                PeekType(uint8_t& type) const;
+    //! The 8 bytes of a DOUBLE, after its marker
+    bool                ReadNumber(double& value);
+    //! A STRING after its marker, or an object key which has no marker
+    bool                ReadShortString(const char*& text, uint16_t& length);
+    //! The element count of an ECMA_ARRAY or STRICT_ARRAY, after its marker
+    bool                ReadArrayCount(uint32_t& count);
+    //! A whole value, marker included
+    bool                SkipValue();
+
+    //! Steps into the array of a script tag named name, e.g. "onMetaData"
+    bool                EnterScriptObject(const char* name);
+    //! Next key of the current OBJECT or ECMA_ARRAY, false at its end marker
+    bool                NextKey(const char*& key, uint16_t& length);
+
+private:
+    bool                SkipValue(int depth);
+    bool                SkipProperties(int depth);
+
+    const uint8_t*      _data;
+    size_t              _size;
+    size_t              _offset     { 0 };
+};
+
+inline bool Amf0KeyIs(const char* key, uint16_t length, const char* name)
+{
+    return strlen(name) == length && memcmp(key, name, length) == 0;
+}
+
+//! Offset of the 8 bytes value of the top level number key of onMetaData
+bool    FindMetadataNumber(const void* data, size_t size, const char* key, size_t& offset);
+//! onMetaData keyframes.times (seconds) and keyframes.filepositions, false
+//! when the object is missing or the two arrays do not match
+bool    FindKeyframeIndex(const void* data, size_t size,
+                          std::vector<double>& times, std::vector<double>& positions);
+double  ReadAmf0Double(const uint8_t* bytes);
+void    WriteAmf0Double(uint8_t* bytes, double value);
+
+FLVPARSER_NAMESPACE_END
+
+#endif // FLVAMF0_H_
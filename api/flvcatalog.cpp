@@ -0,0 +1,597 @@
+/**
+* This file is part of FLVParser.
+
+* FLVParser is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+
+* FLVParser is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+
+* You should have received a copy of the GNU General Public License
+* along with FLVParser.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "common.h"
+#include "flvcatalog.h"
+#include "flvamf0.h"
+
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <memory>
+#include <mutex>
+#include <string.h>
+#include <strings.h>
+#include <sys/stat.h>
+#include <thread>
+#include <unistd.h>
+#include <unordered_set>
+
+FLVPARSER_NAMESPACE_BEGIN
+
+static const char kCatalogMagic[8] = { 'F', 'L', 'V', 'C', 'A', 'T', 'v', '2' };
+// larger script tags are skipped instead of read
+static const uint32_t kCatalogMaxScriptBytes = 1 << 20;
+
+static inline uint32_t ReadUInt32BE(const uint8_t* p)
+{
+    return ((uint32_t)p[0] << 24) | (p[1] << 16) | (p[2] << 8) | p[3];
+}
+
+static CatalogKey MakeKey(const struct stat& st)
+{
+    CatalogKey key;
+    key._device = st.st_dev;
+    key._inode = st.st_ino;
+    key._size = st.st_size;
+    key._mtimeNs = (int64_t)st.st_mtim.tv_sec * 1000000000 + st.st_mtim.tv_nsec;
+    return key;
+}
+
+static void ParseMetadata(const uint8_t* data, size_t size, CatalogEntry& entry)
+{
+    Amf0Reader reader(data, size);
+    if (!reader.EnterScriptObject("onMetaData"))
+        return;
+    struct Field
+    {
+        const char* _name;
+        double*     _value;
+    }
+    fields[] = {
+        { "duration",       &entry._metaDuration },
+        { "width",          &entry._width },
+        { "height",         &entry._height },
+        { "framerate",      &entry._frameRate },
+        { "videodatarate",  &entry._videoDataRate },
+        { "audiodatarate",  &entry._audioDataRate }
+    };
+    const char* key;
+    uint16_t length;
+    while (reader.NextKey(key, length))
+    {
+        uint8_t type;
+        if (!reader.PeekType(type))
+            return;
+        double* value = nullptr;
+        for (size_t idx = 0; idx < sizeof(fields) / sizeof(fields[0]) && type == DOUBLE; idx++)
+        {
+            if (Amf0KeyIs(key, length, fields[idx]._name))
+                value = fields[idx]._value;
+        }
+        if (value)
+        {
+            if (!reader.ReadType(type) || !reader.ReadNumber(*value))
+                return;
+        }
+        else if (!reader.SkipValue())
+        {
+            return;
+        }
+    }
+}
+
+bool FLVCatalog::ScanFile(const char* path, CatalogEntry& entry)
+{
+    ReadOptions readOptions;
+    readOptions._backend = ReadBackendPread;
+    readOptions._blockSize = 256 << 10;
+    std::unique_ptr<FileReader> reader;
+    try
+    {
+        reader.reset(new FileReader(path, readOptions));
+    }
+    catch (char const*)
+    {
+        return false;
+    }
+    uint64_t fileSize = reader->FileSize();
+    uint8_t header[sizeof(FLVHeader) + sizeof(uint32_t)];
+    if (reader->Read(header, sizeof(FLVHeader)) != sizeof(FLVHeader) ||
+        header[0] != 'F' || header[1] != 'L' || header[2] != 'V')
+        return true;
+    entry._bHasAudio = !!(header[4] & 0x04);
+    entry._bHasVideo = !!(header[4] & 0x01);
+    uint32_t dataOffset = ReadUInt32BE(header + 5);
+    if (dataOffset > sizeof(FLVHeader) && !reader->Skip(dataOffset - sizeof(FLVHeader)))
+        return true;
+    if (reader->Read(header, sizeof(uint32_t)) != sizeof(uint32_t))
+        return true;
+    entry._bValid = true;
+
+    std::vector<uint8_t> script;
+    bool bMetadata = false;
+    bool bMediaSeen = false;
+    bool bVideoSeen = false;
+    uint32_t first = 0;
+    uint32_t last = 0;
+    while (true)
+    {
+        FLVTag::FLVTagHeader tag;
+        size_t got = reader->Read(&tag, sizeof(tag));
+        if (got < sizeof(tag))
+        {
+            entry._bTruncated = got != 0;
+            break;
+        }
+        uint32_t dataSize = TagDataSize(tag);
+        if (reader->Tell() + dataSize + sizeof(uint32_t) > fileSize)
+        {
+            entry._bTruncated = true;
+            break;
+        }
+        entry._tags++;
+        uint32_t skip = dataSize;
+        if (tag._tagType == TagTypeScript && !bMetadata && dataSize <= kCatalogMaxScriptBytes)
+        {
+            script.resize(dataSize);
+            if (reader->Read(script.data(), dataSize) != dataSize)
+                break;
+            skip = 0;
+            ParseMetadata(script.data(), dataSize, entry);
+            bMetadata = entry._metaDuration > 0 || entry._width > 0;
+        }
+        else if ((tag._tagType == TagTypeVideo || tag._tagType == TagTypeAudio) && dataSize > 0)
+        {
+            uint8_t media[kMaxVideoHeaderSize];
+            uint32_t want = tag._tagType == TagTypeVideo ? kMaxVideoHeaderSize : 2;
+            if (want > dataSize)
+                want = dataSize;
+            if (reader->Read(media, want) != want)
+                break;
+            skip -= want;
+            uint32_t timestamp = TagTimestamp(tag);
+            if (!bMediaSeen || timestamp < first)
+                first = timestamp;
+            if (!bMediaSeen || timestamp > last)
+                last = timestamp;
+            bMediaSeen = true;
+            if (tag._tagType == TagTypeVideo)
+            {
+                VideoHeaderInfo video;
+                bool bParsed = ParseVideoHeader(media, want, video);
+                if (!bVideoSeen)
+                {
+                    bVideoSeen = true;
+                    if (video._bEnhanced)
+                        entry._videoFourCC = video._fourCC;
+                    else
+                        entry._videoCodec = video._codecID;
+                }
+                if (bParsed && video._frameType == KeyFrame && video._bCodedFrame)
+                    entry._keyframes++;
+            }
+            else if (entry._audioCodec == kCatalogNoCodec)
+            {
+                entry._audioCodec = media[0] >> 4;
+            }
+        }
+        if (!reader->Skip((uint64_t)skip + sizeof(uint32_t)))
+            break;
+    }
+    entry._durationMs = last - first;
+    return true;
+}
+
+// Directories and files still to look at, shared by the scan threads
+class ScanQueue
+{
+public:
+    struct Job
+    {
+        std::string     _path;
+        bool            _bDirectory;
+        CatalogKey      _key;
+    };
+
+    void Push(Job&& job)
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _jobs.push_back(std::move(job));
+        _pending++;
+        _cond.notify_one();
+    }
+
+    //! False once every job is done and no job can be added anymore
+    bool Pop(Job& job)
+    {
+        std::unique_lock<std::mutex> lock(_mutex);
+        while (_jobs.empty() && _pending > 0)
+            _cond.wait(lock);
+        if (_jobs.empty())
+            return false;
+        job = std::move(_jobs.front());
+        _jobs.pop_front();
+        return true;
+    }
+
+    void Done()
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        if (--_pending == 0)
+            _cond.notify_all();
+    }
+
+private:
+    std::mutex              _mutex;
+    std::condition_variable _cond;
+    std::deque<Job>         _jobs;
+    size_t                  _pending    { 0 };      //!< Queued or running
+};
+
+static bool HasExtension(const char* name, const char* extension)
+{
+    if (!extension)
+        return true;
+    size_t length = strlen(name);
+    size_t extensionLength = strlen(extension);
+    return length >= extensionLength && strcasecmp(name + length - extensionLength, extension) == 0;
+}
+
+FLVCatalog::FLVCatalog(const char* catalogFile)
+{
+    if (!catalogFile)
+    {
+        std::cerr << "[failed]: catalog file path is null" << std::endl;
+        throw "[failed]";
+    }
+    _catalogFile = catalogFile;
+    Load();
+}
+
+const CatalogEntry* FLVCatalog::Find(const std::string& path) const
+{
+    auto it = std::lower_bound(_entries.begin(), _entries.end(), path,
+        [](const CatalogEntry& entry, const std::string& value) { return entry._path < value; });
+    return it != _entries.end() && it->_path == path ? &*it : nullptr;
+}
+
+bool FLVCatalog::Update(const char* rootDirectory, const CatalogOptions& options)
+{
+    _lastUpdate = CatalogUpdate();
+    std::string root = rootDirectory ? rootDirectory : "";
+    while (root.size() > 1 && root[root.size() - 1] == '/')
+        root.resize(root.size() - 1);
+    struct stat st;
+    if (root.empty() || stat(root.c_str(), &st) != 0 || !S_ISDIR(st.st_mode))
+    {
+        std::cerr << "[failed]: " << root << " is not a directory" << std::endl;
+        return false;
+    }
+
+    std::unordered_map<CatalogKey, size_t, CatalogKeyHash> known;
+    for (size_t idx = 0; idx < _entries.size(); idx++)
+        known[_entries[idx]._key] = idx;
+
+    std::mutex mutex;                           // guards everything below
+    std::vector<CatalogEntry> found;
+    std::vector<char> bReused(_entries.size(), 0);
+    std::unordered_set<std::string> visited;    // every matching file path of this walk
+    CatalogUpdate update;
+
+    ScanQueue queue;
+    queue.Push(ScanQueue::Job{ root, true, CatalogKey() });
+    auto worker = [&]()
+    {
+        ScanQueue::Job job;
+        while (queue.Pop(job))
+        {
+            if (!job._bDirectory)
+            {
+                CatalogEntry entry;
+                entry._path = job._path;
+                entry._key = job._key;
+                bool bOk = ScanFile(job._path.c_str(), entry);
+                std::lock_guard<std::mutex> lock(mutex);
+                if (bOk)
+                {
+                    found.push_back(std::move(entry));
+                    update._parsed++;
+                }
+                else
+                {
+                    update._failed++;
+                }
+                queue.Done();
+                continue;
+            }
+            DIR* dir = opendir(job._path.c_str());
+            if (!dir)
+            {
+                queue.Done();
+                continue;
+            }
+            uint64_t files = 0;
+            std::vector<std::string> paths;
+            std::vector<CatalogEntry> reused;
+            std::vector<size_t> reusedIndex;
+            while (struct dirent* item = readdir(dir))
+            {
+                if (strcmp(item->d_name, ".") == 0 || strcmp(item->d_name, "..") == 0)
+                    continue;
+                std::string path = job._path + "/" + item->d_name;
+                if (item->d_type == DT_DIR)
+                {
+                    queue.Push(ScanQueue::Job{ path, true, CatalogKey() });
+                    continue;
+                }
+                if (item->d_type != DT_REG && item->d_type != DT_LNK && item->d_type != DT_UNKNOWN)
+                    continue;
+                if (item->d_type == DT_LNK && !options._bFollowSymlinks)
+                    continue;
+                struct stat itemStat;
+                int flags = options._bFollowSymlinks ? 0 : AT_SYMLINK_NOFOLLOW;
+                if (fstatat(dirfd(dir), item->d_name, &itemStat, flags) != 0)
+                    continue;
+                if (S_ISDIR(itemStat.st_mode))
+                {
+                    // symlinked directories are only entered when following links
+                    if (item->d_type != DT_LNK || options._bFollowSymlinks)
+                        queue.Push(ScanQueue::Job{ path, true, CatalogKey() });
+                    continue;
+                }
+                if (!S_ISREG(itemStat.st_mode) || !HasExtension(item->d_name, options._extension))
+                    continue;
+                files++;
+                paths.push_back(path);
+                CatalogKey key = MakeKey(itemStat);
+                auto it = known.find(key);
+                if (it != known.end())
+                {
+                    // unchanged, possibly renamed
+                    reused.push_back(_entries[it->second]);
+                    reused.back()._path = path;
+                    reusedIndex.push_back(it->second);
+                    continue;
+                }
+                queue.Push(ScanQueue::Job{ path, false, key });
+            }
+            closedir(dir);
+            std::lock_guard<std::mutex> lock(mutex);
+            update._directories++;
+            update._files += files;
+            update._reused += reused.size();
+            for (size_t idx = 0; idx < paths.size(); idx++)
+                visited.insert(std::move(paths[idx]));
+            for (size_t idx = 0; idx < reused.size(); idx++)
+            {
+                bReused[reusedIndex[idx]] = 1;
+                found.push_back(std::move(reused[idx]));
+            }
+            queue.Done();
+        }
+    };
+
+    uint32_t threads = options._threads ? options._threads : std::thread::hardware_concurrency();
+    if (threads == 0)
+        threads = 1;
+    std::vector<std::thread> pool;
+    for (uint32_t idx = 1; idx < threads; idx++)
+        pool.push_back(std::thread(worker));
+    worker();
+    for (size_t idx = 0; idx < pool.size(); idx++)
+        pool[idx].join();
+
+    // entries of other trees stay, the ones under root go when neither their
+    // path nor their file (renamed) was seen again; a modified file is
+    // parsed again under the same path and is not counted as removed
+    std::string prefix = root == "/" ? root : root + "/";
+    for (size_t idx = 0; idx < _entries.size(); idx++)
+    {
+        const std::string& path = _entries[idx]._path;
+        bool bUnderRoot = path.compare(0, prefix.size(), prefix) == 0;
+        if (!bUnderRoot)
+            found.push_back(std::move(_entries[idx]));
+        else if (!bReused[idx] && visited.find(path) == visited.end())
+            update._removed++;
+    }
+    std::sort(found.begin(), found.end(),
+        [](const CatalogEntry& a, const CatalogEntry& b) { return a._path < b._path; });
+    // a file seen twice (hard links) is kept once per path
+    found.erase(std::unique(found.begin(), found.end(),
+        [](const CatalogEntry& a, const CatalogEntry& b) { return a._path == b._path; }), found.end());
+    _entries.swap(found);
+    _lastUpdate = update;
+    return true;
+}
+
+// Little endian serialization of the catalog file
+static void PutUInt(std::string& out, uint64_t value, int bytes)
+{
+    for (int idx = 0; idx < bytes; idx++)
+        out.push_back((char)(value >> (idx * 8)));
+}
+
+static void PutDouble(std::string& out, double value)
+{
+    uint64_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    PutUInt(out, bits, 8);
+}
+
+class CatalogInput
+{
+public:
+    CatalogInput(const std::string& data) : _data(data) {}
+
+    bool GetUInt(uint64_t& value, int bytes)
+    {
+        if (_offset + bytes > _data.size())
+            return false;
+        value = 0;
+        for (int idx = bytes - 1; idx >= 0; idx--)
+            value = (value << 8) | (uint8_t)_data[_offset + idx];
+        _offset += bytes;
+        return true;
+    }
+
+    bool GetDouble(double& value)
+    {
+        uint64_t bits;
+        if (!GetUInt(bits, 8))
+            return false;
+        memcpy(&value, &bits, sizeof(value));
+        return true;
+    }
+
+    bool GetString(std::string& value, size_t size)
+    {
+        if (_offset + size > _data.size())
+            return false;
+        value.assign(_data, _offset, size);
+        _offset += size;
+        return true;
+    }
+
+private:
+    const std::string&  _data;
+    size_t              _offset     { 0 };
+};
+
+bool FLVCatalog::Save() const
+{
+    std::string out(kCatalogMagic, sizeof(kCatalogMagic));
+    PutUInt(out, _entries.size(), 8);
+    for (size_t idx = 0; idx < _entries.size(); idx++)
+    {
+        const CatalogEntry& entry = _entries[idx];
+        PutUInt(out, entry._path.size(), 4);
+        out += entry._path;
+        PutUInt(out, entry._key._device, 8);
+        PutUInt(out, entry._key._inode, 8);
+        PutUInt(out, entry._key._size, 8);
+        PutUInt(out, (uint64_t)entry._key._mtimeNs, 8);
+        PutUInt(out, (entry._bValid ? 1 : 0) | (entry._bTruncated ? 2 : 0) |
+                     (entry._bHasAudio ? 4 : 0) | (entry._bHasVideo ? 8 : 0), 1);
+        PutUInt(out, entry._videoCodec, 1);
+        PutUInt(out, entry._videoFourCC, 4);
+        PutUInt(out, entry._audioCodec, 1);
+        PutUInt(out, entry._tags, 8);
+        PutUInt(out, entry._keyframes, 4);
+        PutUInt(out, entry._durationMs, 4);
+        PutDouble(out, entry._metaDuration);
+        PutDouble(out, entry._width);
+        PutDouble(out, entry._height);
+        PutDouble(out, entry._frameRate);
+        PutDouble(out, entry._videoDataRate);
+        PutDouble(out, entry._audioDataRate);
+    }
+
+    std::string temporary = _catalogFile + ".tmp";
+    int fd = open(temporary.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0)
+    {
+        std::cerr << "[failed]: could not create the " << temporary << std::endl;
+        return false;
+    }
+    size_t written = 0;
+    while (written < out.size())
+    {
+        ssize_t n = write(fd, out.data() + written, out.size() - written);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            break;
+        written += n;
+    }
+    bool bOk = written == out.size() && fsync(fd) == 0;
+    close(fd);
+    if (!bOk || rename(temporary.c_str(), _catalogFile.c_str()) != 0)
+    {
+        std::cerr << "[failed]: writing the catalog " << _catalogFile << " failed" << std::endl;
+        unlink(temporary.c_str());
+        return false;
+    }
+    return true;
+}
+
+bool FLVCatalog::Load()
+{
+    int fd = open(_catalogFile.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        return errno == ENOENT;
+    std::string data;
+    char buffer[1 << 16];
+    ssize_t n;
+    while ((n = read(fd, buffer, sizeof(buffer))) != 0)
+    {
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n < 0)
+            break;
+        data.append(buffer, n);
+    }
+    close(fd);
+
+    CatalogInput input(data);
+    std::string magic;
+    uint64_t count = 0;
+    if (!input.GetString(magic, sizeof(kCatalogMagic)) ||
+        memcmp(magic.data(), kCatalogMagic, sizeof(kCatalogMagic)) != 0 || !input.GetUInt(count, 8))
+    {
+        std::cerr << "[warning]: " << _catalogFile << " is not a catalog, starting empty" << std::endl;
+        return false;
+    }
+    std::vector<CatalogEntry> entries;
+    for (uint64_t idx = 0; idx < count; idx++)
+    {
+        CatalogEntry entry;
+        uint64_t length, mtime, flags, videoCodec, videoFourCC, audioCodec, keyframes, duration;
+        bool bOk = input.GetUInt(length, 4) && input.GetString(entry._path, length) &&
+                   input.GetUInt(entry._key._device, 8) && input.GetUInt(entry._key._inode, 8) &&
+                   input.GetUInt(entry._key._size, 8) && input.GetUInt(mtime, 8) &&
+                   input.GetUInt(flags, 1) && input.GetUInt(videoCodec, 1) &&
+                   input.GetUInt(videoFourCC, 4) && input.GetUInt(audioCodec, 1) &&
+                   input.GetUInt(entry._tags, 8) && input.GetUInt(keyframes, 4) && input.GetUInt(duration, 4) &&
+                   input.GetDouble(entry._metaDuration) && input.GetDouble(entry._width) &&
+                   input.GetDouble(entry._height) && input.GetDouble(entry._frameRate) &&
+                   input.GetDouble(entry._videoDataRate) && input.GetDouble(entry._audioDataRate);
+        if (!bOk)
+        {
+            std::cerr << "[warning]: " << _catalogFile << " is truncated, starting empty" << std::endl;
+            return false;
+        }
+        entry._key._mtimeNs = (int64_t)mtime;
+        entry._bValid = !!(flags & 1);
+        entry._bTruncated = !!(flags & 2);
+        entry._bHasAudio = !!(flags & 4);
+        entry._bHasVideo = !!(flags & 8);
+        entry._videoCodec = (uint8_t)videoCodec;
+        entry._videoFourCC = (uint32_t)videoFourCC;
+        entry._audioCodec = (uint8_t)audioCodec;
+        entry._keyframes = (uint32_t)keyframes;
+        entry._durationMs = (uint32_t)duration;
+        entries.push_back(std::move(entry));
+    }
+    _entries.swap(entries);
+    return true;
+}
+
+FLVPARSER_NAMESPACE_END
@@ -0,0 +1,133 @@
+/**
+* This file is part of FLVParser.
+
+* FLVParser is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+
+* FLVParser is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+
+* You should have received a copy of the GNU General Public License
+* along with FLVParser.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef FLVCATALOG_H_
+#define FLVCATALOG_H_
+
+#include "common.h"
+#include "flvparser.h"
+
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+FLVPARSER_NAMESPACE_BEGIN
+
+// Identity of a file version, an entry is reused while all four match
+struct CatalogKey
+{
+    uint64_t        _device     { 0 };
+    uint64_t        _inode      { 0 };
+    uint64_t        _size       { 0 };
+    int64_t         _mtimeNs    { 0 };
+
+    bool operator== (const CatalogKey& other) const
+    {
+        return _device == other._device && _inode == other._inode &&
+               _size == other._size && _mtimeNs == other._mtimeNs;
+    }
+};
+
+struct CatalogKeyHash
+{
+    size_t operator() (const CatalogKey& key) const
+    {
+        uint64_t hash = key._inode * 0x9E3779B97F4A7C15ULL;
+        hash ^= key._device + (hash << 6) + (hash >> 2);
+        hash ^= key._size + (hash << 6) + (hash >> 2);
+        hash ^= (uint64_t)key._mtimeNs + (hash << 6) + (hash >> 2);
+        return (size_t)hash;
+    }
+};
+
+static const uint8_t kCatalogNoCodec = 0xFF;
+
+struct CatalogEntry
+{
+    std::string     _path;
+    CatalogKey      _key;
+    bool            _bValid             { false };  //!< FLV signature and header were fine
+    bool            _bTruncated         { false };  //!< The last tag runs past the end of the file
+    bool            _bHasAudio          { false };  //!< Header flags
+    bool            _bHasVideo          { false };
+    uint8_t         _videoCodec         { kCatalogNoCodec };    //!< CodecID of the first video tag
+    uint32_t        _videoFourCC        { 0 };      //!< Instead when that tag is enhanced
+    uint8_t         _audioCodec         { kCatalogNoCodec };    //!< SoundFormat of the first audio tag
+    uint64_t        _tags               { 0 };
+    uint32_t        _keyframes          { 0 };
+    uint32_t        _durationMs         { 0 };      //!< From the tag timestamps
+    // onMetaData essentials, 0 when absent
+    double          _metaDuration       { 0 };      //!< Seconds
+    double          _width              { 0 };
+    double          _height             { 0 };
+    double          _frameRate          { 0 };
+    double          _videoDataRate      { 0 };      //!< kbit/s
+    double          _audioDataRate      { 0 };
+};
+
+struct CatalogOptions
+{
+    uint32_t        _threads            { 0 };          //!< 0 uses every hardware thread
+    const char*     _extension          { ".flv" };     //!< Case insensitive, nullptr takes every file
+    bool            _bFollowSymlinks    { false };
+};
+
+struct CatalogUpdate
+{
+    uint64_t        _directories        { 0 };
+    uint64_t        _files              { 0 };
+    uint64_t        _parsed             { 0 };      //!< New or changed files
+    uint64_t        _reused             { 0 };
+    uint64_t        _removed            { 0 };      //!< Entries whose file is gone
+    uint64_t        _failed             { 0 };      //!< Files that could not be opened
+};
+
+// On-disk catalog of FLV files. Update() walks a directory tree on a pool
+// of threads and only parses the files whose (device, inode, size, mtime)
+// is not in the catalog yet. A file is read header by header, payloads
+// are skipped except for onMetaData.
+class FLVCatalog
+{
+public:
+    //! Loads the catalog if the file exists, it is created by Save()
+    explicit FLVCatalog(const char* catalogFile);
+
+    FLVCatalog(const FLVCatalog&)               = delete;
+    FLVCatalog& operator= (const FLVCatalog&)   = delete;
+
+    bool                Update(const char* rootDirectory, const CatalogOptions& options = CatalogOptions());
+    //! Written to a temporary file first, then renamed over the catalog
+    bool                Save() const;
+
+    const std::vector<CatalogEntry>&    Entries() const     { return _entries; }
+    const CatalogEntry*                 Find(const std::string& path) const;
+    const CatalogUpdate&                LastUpdate() const  { return _lastUpdate; }
+
+    //! Header only scan of one file, false when it can not be opened
+    static bool         ScanFile(const char* path, CatalogEntry& entry);
+
+private:
+    bool                Load();
+
+    std::string         _catalogFile;
+    std::vector<CatalogEntry> _entries;         //!< Sorted by path
+    CatalogUpdate       _lastUpdate;
+};
+
+FLVPARSER_NAMESPACE_END
+
+#endif // FLVCATALOG_H_
@@ -0,0 +1,478 @@
+/**
+* This file is part of FLVParser.
+
+* FLVParser is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+
+* FLVParser is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+
+* You should have received a copy of the GNU General Public License
+* along with FLVParser.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "common.h"
+#include "flvchecksum.h"
+
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <cpuid.h>
+#include <nmmintrin.h>
+#define FLVPARSER_CRC32C_SSE42
+#elif defined(__aarch64__) && defined(__ARM_FEATURE_CRC32)
+#include <arm_acle.h>
+#define FLVPARSER_CRC32C_ARMV8
+#endif
+
+FLVPARSER_NAMESPACE_BEGIN
+
+const char* ChecksumName(ChecksumType type)
+{
+    switch (type)
+    {
+    case ChecksumCrc32c:
+        return "crc32c";
+    case ChecksumXXHash64:
+        return "xxhash64";
+    default:
+        return "unknown";
+    }
+}
+
+static inline uint64_t LoadUInt64LE(const uint8_t* p)
+{
+    uint64_t value;
+    memcpy(&value, p, sizeof(value));
+#if PARSER_ENDIAN == PARSER_BIGENDIAN
+    value = __builtin_bswap64(value);
+#endif
+    return value;
+}
+
+static inline uint32_t LoadUInt32LE(const uint8_t* p)
+{
+    uint32_t value;
+    memcpy(&value, p, sizeof(value));
+#if PARSER_ENDIAN == PARSER_BIGENDIAN
+    value = __builtin_bswap32(value);
+#endif
+    return value;
+}
+
+// CRC32C, reflected Castagnoli polynomial
+static const uint32_t kCrc32cPolynomial = 0x82F63B78;
+
+// Slicing-by-8 tables of the portable implementation
+struct Crc32cTables
+{
+    uint32_t _table[8][256];
+
+    Crc32cTables()
+    {
+        for (uint32_t idx = 0; idx < 256; idx++)
+        {
+            uint32_t crc = idx;
+            for (int bit = 0; bit < 8; bit++)
+                crc = (crc >> 1) ^ (kCrc32cPolynomial & (0 - (crc & 1)));
+            _table[0][idx] = crc;
+        }
+        for (uint32_t idx = 0; idx < 256; idx++)
+        {
+            for (int slice = 1; slice < 8; slice++)
+                _table[slice][idx] = (_table[slice - 1][idx] >> 8) ^ _table[0][_table[slice - 1][idx] & 0xFF];
+        }
+    }
+};
+
+static uint32_t Crc32cTable(uint32_t crc, const uint8_t* p, size_t size)
+{
+    static const Crc32cTables tables;
+    const uint32_t (*t)[256] = tables._table;
+    while (size >= 8)
+    {
+        uint32_t low = LoadUInt32LE(p) ^ crc;
+        uint32_t high = LoadUInt32LE(p + 4);
+        crc = t[7][low & 0xFF] ^ t[6][(low >> 8) & 0xFF] ^ t[5][(low >> 16) & 0xFF] ^ t[4][low >> 24] ^
+              t[3][high & 0xFF] ^ t[2][(high >> 8) & 0xFF] ^ t[1][(high >> 16) & 0xFF] ^ t[0][high >> 24];
+        p += 8;
+        size -= 8;
+    }
+    while (size--)
+        crc = (crc >> 8) ^ t[0][(crc ^ *p++) & 0xFF];
+    return crc;
+}
+
+#if defined(FLVPARSER_CRC32C_SSE42)
+__attribute__((target("sse4.2")))
+static uint32_t Crc32cHardware(uint32_t crc, const uint8_t* p, size_t size)
+{
+#ifdef __x86_64__
+    uint64_t crc64 = crc;
+    while (size >= 8)
+    {
+        uint64_t value;
+        memcpy(&value, p, sizeof(value));
+        crc64 = _mm_crc32_u64(crc64, value);
+        p += 8;
+        size -= 8;
+    }
+    crc = (uint32_t)crc64;
+#endif
+    while (size >= 4)
+    {
+        uint32_t value;
+        memcpy(&value, p, sizeof(value));
+        crc = _mm_crc32_u32(crc, value);
+        p += 4;
+        size -= 4;
+    }
+    while (size--)
+        crc = _mm_crc32_u8(crc, *p++);
+    return crc;
+}
+
+static bool HasCrc32cHardware()
+{
+    unsigned int eax, ebx, ecx, edx;
+    return __get_cpuid(1, &eax, &ebx, &ecx, &edx) && (ecx & bit_SSE4_2);
+}
+#elif defined(FLVPARSER_CRC32C_ARMV8)
+static uint32_t Crc32cHardware(uint32_t crc, const uint8_t* p, size_t size)
+{
+    while (size >= 8)
+    {
+        uint64_t value;
+        memcpy(&value, p, sizeof(value));
+        crc = __crc32cd(crc, value);
+        p += 8;
+        size -= 8;
+    }
+    while (size--)
+        crc = __crc32cb(crc, *p++);
+    return crc;
+}
+
+// the compiler was told the target has the CRC extension
+static bool HasCrc32cHardware()
+{
+    return true;
+}
+#endif
+
+typedef uint32_t (*Crc32cFunction)(uint32_t, const uint8_t*, size_t);
+
+static Crc32cFunction SelectCrc32c()
+{
+#if defined(FLVPARSER_CRC32C_SSE42) || defined(FLVPARSER_CRC32C_ARMV8)
+    if (HasCrc32cHardware())
+        return &Crc32cHardware;
+#endif
+    return &Crc32cTable;
+}
+
+static const Crc32cFunction g_crc32c = SelectCrc32c();
+
+const char* Crc32cBackend()
+{
+    if (g_crc32c == &Crc32cTable)
+        return "table";
+#if defined(FLVPARSER_CRC32C_SSE42)
+    return "sse4.2";
+#else
+    return "armv8";
+#endif
+}
+
+uint32_t Crc32c(const void* data, size_t size, uint32_t crc)
+{
+    // the dispatch pointer may not be set yet during static initialization
+    Crc32cFunction function = g_crc32c ? g_crc32c : SelectCrc32c();
+    return ~function(~crc, static_cast<const uint8_t*>(data), size);
+}
+
+// xxHash64, the reference algorithm by Yann Collet
+static const uint64_t kXXPrime1 = 11400714785074694791ULL;
+static const uint64_t kXXPrime2 = 14029467366897019727ULL;
+static const uint64_t kXXPrime3 = 1609587929392839161ULL;
+static const uint64_t kXXPrime4 = 9650029242287828579ULL;
+static const uint64_t kXXPrime5 = 2870177450012600261ULL;
+
+static inline uint64_t RotateLeft(uint64_t value, int bits)
+{
+    return (value << bits) | (value >> (64 - bits));
+}
+
+static inline uint64_t XXRound(uint64_t acc, uint64_t input)
+{
+    acc += input * kXXPrime2;
+    acc = RotateLeft(acc, 31);
+    return acc * kXXPrime1;
+}
+
+static inline uint64_t XXMergeRound(uint64_t acc, uint64_t value)
+{
+    acc ^= XXRound(0, value);
+    return acc * kXXPrime1 + kXXPrime4;
+}
+
+// Consumes whole 32 bytes stripes, returns the bytes used
+static size_t XXStripes(uint64_t lanes[4], const uint8_t* p, size_t size)
+{
+    size_t used = 0;
+    uint64_t v1 = lanes[0], v2 = lanes[1], v3 = lanes[2], v4 = lanes[3];
+    while (size - used >= 32)
+    {
+        v1 = XXRound(v1, LoadUInt64LE(p + used));
+        v2 = XXRound(v2, LoadUInt64LE(p + used + 8));
+        v3 = XXRound(v3, LoadUInt64LE(p + used + 16));
+        v4 = XXRound(v4, LoadUInt64LE(p + used + 24));
+        used += 32;
+    }
+    lanes[0] = v1;
+    lanes[1] = v2;
+    lanes[2] = v3;
+    lanes[3] = v4;
+    return used;
+}
+
+static uint64_t XXFinish(const uint64_t lanes[4], uint64_t seed, uint64_t total,
+                         const uint8_t* p, size_t size)
+{
+    uint64_t hash;
+    if (total >= 32)
+    {
+        hash = RotateLeft(lanes[0], 1) + RotateLeft(lanes[1], 7) +
+               RotateLeft(lanes[2], 12) + RotateLeft(lanes[3], 18);
+        for (int idx = 0; idx < 4; idx++)
+            hash = XXMergeRound(hash, lanes[idx]);
+    }
+    else
+    {
+        hash = seed + kXXPrime5;
+    }
+    hash += total;
+    while (size >= 8)
+    {
+        hash ^= XXRound(0, LoadUInt64LE(p));
+        hash = RotateLeft(hash, 27) * kXXPrime1 + kXXPrime4;
+        p += 8;
+        size -= 8;
+    }
+    if (size >= 4)
+    {
+        hash ^= (uint64_t)LoadUInt32LE(p) * kXXPrime1;
+        hash = RotateLeft(hash, 23) * kXXPrime2 + kXXPrime3;
+        p += 4;
+        size -= 4;
+    }
+    while (size--)
+    {
+        hash ^= (*p++) * kXXPrime5;
+        hash = RotateLeft(hash, 11) * kXXPrime1;
+    }
+    hash ^= hash >> 33;
+    hash *= kXXPrime2;
+    hash ^= hash >> 29;
+    hash *= kXXPrime3;
+    hash ^= hash >> 32;
+    return hash;
+}
+
+static void XXReset(uint64_t lanes[4], uint64_t seed)
+{
+    lanes[0] = seed + kXXPrime1 + kXXPrime2;
+    lanes[1] = seed + kXXPrime2;
+    lanes[2] = seed;
+    lanes[3] = seed - kXXPrime1;
+}
+
+uint64_t XXHash64(const void* data, size_t size, uint64_t seed)
+{
+    const uint8_t* p = static_cast<const uint8_t*>(data);
+    uint64_t lanes[4];
+    XXReset(lanes, seed);
+    size_t used = XXStripes(lanes, p, size);
+    return XXFinish(lanes, seed, size, p + used, size - used);
+}
+
+Checksum::Checksum(ChecksumType type, uint64_t seed)
+                : _type(type), _seed(seed)
+{
+    Reset();
+}
+
+void Checksum::Reset()
+{
+    _total = 0;
+    _crc = (uint32_t)_seed;
+    _pendingSize = 0;
+    XXReset(_lanes, _seed);
+}
+
+void Checksum::Update(const void* data, size_t size)
+{
+    const uint8_t* p = static_cast<const uint8_t*>(data);
+    _total += size;
+    if (_type == ChecksumCrc32c)
+    {
+        _crc = Crc32c(p, size, _crc);
+        return;
+    }
+    if (_pendingSize)
+    {
+        size_t fill = 32 - _pendingSize < size ? 32 - _pendingSize : size;
+        memcpy(_pending + _pendingSize, p, fill);
+        _pendingSize += fill;
+        p += fill;
+        size -= fill;
+        if (_pendingSize < 32)
+            return;
+        XXStripes(_lanes, _pending, 32);
+        _pendingSize = 0;
+    }
+    size_t used = XXStripes(_lanes, p, size);
+    memcpy(_pending, p + used, size - used);
+    _pendingSize = size - used;
+}
+
+uint64_t Checksum::Value() const
+{
+    if (_type == ChecksumCrc32c)
+        return _crc;
+    return XXFinish(_lanes, _seed, _total, _pending, _pendingSize);
+}
+
+ChecksumSource::ChecksumSource(ByteSource* source, ChecksumType type)
+                : _source(source), _checksum(type)
+{
+    if (!source)
+    {
+        std::cerr << "[failed]: input byte source is null" << std::endl;
+        throw "[failed]";
+    }
+}
+
+size_t ChecksumSource::Read(void* buffer, size_t size)
+{
+    size_t got = _source->Read(buffer, size);
+    _checksum.Update(buffer, got);
+    FLVPARSER_STATS(_readCalls = _source->ReadCalls());
+    return got;
+}
+
+bool ChecksumSource::Seek(uint64_t offset)
+{
+    if (offset == _source->Tell())
+        return true;
+    if (offset != 0 || !_source->Rewind())
+        return false;
+    _checksum.Reset();
+    return true;
+}
+
+const uint8_t* ChecksumSource::Borrow(size_t size)
+{
+    const uint8_t* data = _source->Borrow(size);
+    if (data)
+        _checksum.Update(data, size);
+    return data;
+}
+
+TagChecksummer::TagChecksummer(ChecksumType type, TagChecksumCallback onTag, GopChecksumCallback onGop)
+                : _onTag(onTag), _onGop(onGop), _tag(type), _gop(type)
+{
+
+}
+
+uint64_t TagChecksummer::OnTag(const FLVTag* tag, const uint8_t* media, size_t mediaSize,
+                               const void* payload, int size)
+{
+    _tag.Reset();
+    _tag.Update(media, mediaSize);
+    if (size > 0)
+        _tag.Update(payload, size);
+    _current = _tag.Value();
+    if (_onTag)
+        _onTag(tag, (int)mediaSize + size, _current);
+    return _current;
+}
+
+void TagChecksummer::OnVideo(const FLVTag* tag, bool bKeyframe)
+{
+    if (bKeyframe)
+    {
+        Finish();
+        _bInGop = true;
+        _gop.Reset();
+        _gopInfo = GopChecksum();
+        _gopInfo._timestamp = TagTimestamp(tag->_header);
+    }
+    if (!_bInGop)
+        return;
+    // the GOP checksum covers the checksums of its tags
+    uint8_t bytes[8];
+    for (int idx = 0; idx < 8; idx++)
+        bytes[idx] = (uint8_t)(_current >> (idx * 8));
+    _gop.Update(bytes, sizeof(bytes));
+    _gopInfo._tags++;
+    _gopInfo._bytes += TagDataSize(tag->_header);
+}
+
+void TagChecksummer::Finish()
+{
+    if (!_bInGop)
+        return;
+    _bInGop = false;
+    _gopInfo._checksum = _gop.Value();
+    if (_onGop)
+        _onGop(_gopInfo);
+}
+
+ParsingVideoTag TagChecksummer::VideoTagHandler(ParsingVideoTag next)
+{
+    return [this, next](FLVTag* tag, int size, uint32_t preSize,
+                        AVCPacket::AVCPacketHeader* AVCHeader, uint8_t vp6Byte)
+    {
+        const VideoTag* video = static_cast<const VideoTag*>(tag->_data);
+        uint8_t media[kMaxVideoHeaderSize];
+        size_t mediaSize = WriteVideoHeader(*video, AVCHeader, vp6Byte, media);
+        VideoHeaderInfo info;
+        ParseVideoHeader(media, mediaSize, info);
+        OnTag(tag, media, mediaSize, video->_data, size);
+        if (!info._bSequenceHeader)
+            OnVideo(tag, info._frameType == KeyFrame && info._bCodedFrame);
+        next(tag, size, preSize, AVCHeader, vp6Byte);
+    };
+}
+
+ParsingAudioTag TagChecksummer::AudioTagHandler(ParsingAudioTag next)
+{
+    return [this, next](FLVTag* tag, int size, uint32_t preSize, uint8_t AACPacketType)
+    {
+        const AudioTag* audio = static_cast<const AudioTag*>(tag->_data);
+        uint8_t media[2];
+        size_t mediaSize = 0;
+        memcpy(media, &audio->_header, sizeof(audio->_header));
+        mediaSize += sizeof(audio->_header);
+        if (audio->_header._soundFormat == AAC)
+            media[mediaSize++] = AACPacketType;
+        OnTag(tag, media, mediaSize, audio->_data, size);
+        next(tag, size, preSize, AACPacketType);
+    };
+}
+
+ParsingScriptTag TagChecksummer::ScriptTagHandler(ParsingScriptTag next)
+{
+    return [this, next](FLVTag* tag, int size, uint32_t preSize)
+    {
+        OnTag(tag, nullptr, 0, tag->_data, size);
+        next(tag, size, preSize);
+    };
+}
+
+FLVPARSER_NAMESPACE_END
@@ -0,0 +1,136 @@
+/**
+* This file is part of FLVParser.
+
+* FLVParser is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+
+* FLVParser is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+
+* You should have received a copy of the GNU General Public License
+* along with FLVParser.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef FLVCHECKSUM_H_
+#define FLVCHECKSUM_H_
+
+#include "common.h"
+#include "flvparser.h"
+
+#include <functional>
+#include <stddef.h>
+
+FLVPARSER_NAMESPACE_BEGIN
+
+enum ChecksumType
+{
+    ChecksumCrc32c = 0,                     //!< SSE4.2 or ARMv8 CRC instructions when available
+    ChecksumXXHash64
+};
+
+const char* ChecksumName(ChecksumType type);
+//! Implementation Crc32c() runs on: "sse4.2", "armv8" or "table"
+const char* Crc32cBackend();
+
+//! Extends crc, the CRC32C of the bytes before, by size more bytes
+uint32_t    Crc32c(const void* data, size_t size, uint32_t crc = 0);
+uint64_t    XXHash64(const void* data, size_t size, uint64_t seed = 0);
+
+// Incremental checksum of either type, the value equals the one shot
+// function over all the bytes passed to Update()
+class Checksum
+{
+public:
+    explicit Checksum(ChecksumType type = ChecksumCrc32c, uint64_t seed = 0);
+
+    void                Update(const void* data, size_t size);
+    uint64_t            Value() const;
+    void                Reset();
+    ChecksumType        Type() const        { return _type; }
+    uint64_t            Bytes() const       { return _total; }
+
+private:
+    ChecksumType        _type;
+    uint64_t            _seed;
+    uint64_t            _total          { 0 };
+    uint32_t            _crc            { 0 };
+    uint64_t            _lanes[4];              //!< xxHash64 accumulators
+    uint8_t             _pending[32];           //!< xxHash64 bytes short of a stripe
+    uint32_t            _pendingSize    { 0 };
+};
+
+// Hashes every byte read from another source, so the checksum of the whole
+// file comes with the parse instead of a second read. Skipped bytes are
+// read and hashed too; the only real seek is Rewind(), which restarts.
+class ChecksumSource : public ByteSource
+{
+public:
+    ChecksumSource(ByteSource* source, ChecksumType type = ChecksumCrc32c);
+
+    size_t              Read(void* buffer, size_t size) override;
+    bool                Eof() const override        { return _source->Eof(); }
+    uint64_t            Tell() const override       { return _source->Tell(); }
+    bool                Seek(uint64_t offset) override;
+    const uint8_t*      Borrow(size_t size) override;
+    uint64_t            Size() const override           { return _source->Size(); }
+
+    const Checksum&     Whole() const               { return _checksum; }
+
+private:
+    ByteSource*         _source;
+    Checksum            _checksum;
+};
+
+//! One video GOP, from a keyframe up to the next one
+struct GopChecksum
+{
+    uint32_t            _timestamp      { 0 };  //!< Of the keyframe
+    uint32_t            _tags           { 0 };
+    uint64_t            _bytes          { 0 };
+    uint64_t            _checksum       { 0 };
+};
+
+using TagChecksumCallback = std::function<void(const FLVTag*, int, uint64_t)>;
+using GopChecksumCallback = std::function<void(const GopChecksum&)>;
+
+// Checksums the data of every tag, its audio/video header bytes included,
+// so equal frames hash equal whatever their timestamps. The value is handed
+// to the optional callback and stays readable through Current() while the
+// wrapped parser callbacks run. Video tags are also folded into per GOP
+// checksums for finding identical GOPs between uploads.
+class TagChecksummer
+{
+public:
+    explicit TagChecksummer(ChecksumType type = ChecksumCrc32c,
+                            TagChecksumCallback onTag = nullptr,
+                            GopChecksumCallback onGop = nullptr);
+
+    ParsingVideoTag     VideoTagHandler(ParsingVideoTag next = &DoNothingOnVideoTag);
+    ParsingAudioTag     AudioTagHandler(ParsingAudioTag next = &DoNothingOnAudioTag);
+    ParsingScriptTag    ScriptTagHandler(ParsingScriptTag next = &DoNothingOnScriptTag);
+
+    uint64_t            Current() const     { return _current; }
+    //! Reports the last GOP, call it once the parse is done
+    void                Finish();
+
+private:
+    uint64_t            OnTag(const FLVTag* tag, const uint8_t* media, size_t mediaSize,
+                              const void* payload, int size);
+    void                OnVideo(const FLVTag* tag, bool bKeyframe);
+
+    TagChecksumCallback _onTag;
+    GopChecksumCallback _onGop;
+    Checksum            _tag;
+    Checksum            _gop;
+    GopChecksum         _gopInfo;
+    bool                _bInGop         { false };
+    uint64_t            _current        { 0 };
+};
+
+FLVPARSER_NAMESPACE_END
+
+#endif // FLVCHECKSUM_H_
@@ -0,0 +1,290 @@
+/**
+* This file is part of FLVParser.
+
+* FLVParser is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+
+* FLVParser is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+
+* You should have received a copy of the GNU General Public License
+* along with FLVParser.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "common.h"
+#include "flvfanout.h"
+
+#include <new>
+#include <stddef.h>
+#include <string.h>
+
+FLVPARSER_NAMESPACE_BEGIN
+
+static const uint8_t kSharedTagKeyframe       = 0x01;
+static const uint8_t kSharedTagSequenceHeader = 0x02;
+
+struct SharedTag::Buffer
+{
+    std::atomic<uint32_t>   _refs;
+    uint32_t                _size;
+    uint32_t                _timestamp;
+    uint8_t                 _type;
+    uint8_t                 _flags;
+    uint8_t                 _data[1];
+};
+
+SharedTag::SharedTag(const SharedTag& other)
+                : _buffer(other._buffer)
+{
+    if (_buffer)
+        _buffer->_refs.fetch_add(1, std::memory_order_relaxed);
+}
+
+SharedTag::~SharedTag()
+{
+    if (_buffer && _buffer->_refs.fetch_sub(1, std::memory_order_acq_rel) == 1)
+    {
+        _buffer->~Buffer();
+        ::operator delete(_buffer);
+    }
+}
+
+SharedTag& SharedTag::operator= (const SharedTag& other)
+{
+    SharedTag copy(other);
+    std::swap(_buffer, copy._buffer);
+    return *this;
+}
+
+SharedTag& SharedTag::operator= (SharedTag&& other)
+{
+    if (this != &other)
+    {
+        SharedTag old(std::move(*this));
+        _buffer = other._buffer;
+        other._buffer = nullptr;
+    }
+    return *this;
+}
+
+SharedTag SharedTag::Create(const FLVTag::FLVTagHeader& header,
+                            const void* media, size_t mediaSize,
+                            const void* payload, size_t payloadSize)
+{
+    size_t dataSize = mediaSize + payloadSize;
+    size_t size = sizeof(FLVTag::FLVTagHeader) + dataSize + sizeof(uint32_t);
+    void* memory = ::operator new(offsetof(Buffer, _data) + size);
+    Buffer* buffer = new (memory) Buffer;
+    buffer->_refs.store(1, std::memory_order_relaxed);
+    buffer->_size = (uint32_t)size;
+    buffer->_timestamp = TagTimestamp(header);
+    buffer->_type = header._tagType;
+    buffer->_flags = 0;
+
+    const uint8_t* bytes = static_cast<const uint8_t*>(media);
+    if (header._tagType == TagTypeScript)
+    {
+        buffer->_flags |= kSharedTagSequenceHeader;
+    }
+    else if (header._tagType == TagTypeVideo && mediaSize > 0)
+    {
+        VideoHeaderInfo video;
+        ParseVideoHeader(bytes, mediaSize, video);
+        if (video._bSequenceHeader)
+            buffer->_flags |= kSharedTagSequenceHeader;
+        else if (video.IsKeyframe())
+            buffer->_flags |= kSharedTagKeyframe;
+    }
+    else if (header._tagType == TagTypeAudio && mediaSize > 1)
+    {
+        const AudioTag::AudioTagHeader* audio = (const AudioTag::AudioTagHeader*)bytes;
+        if (audio->_soundFormat == AAC && bytes[1] == AACSequenceHeader)
+            buffer->_flags |= kSharedTagSequenceHeader;
+    }
+
+    uint8_t* out = buffer->_data;
+    memcpy(out, &header, sizeof(FLVTag::FLVTagHeader));
+    out[1] = (uint8_t)(dataSize >> 16);
+    out[2] = (uint8_t)(dataSize >> 8);
+    out[3] = (uint8_t)dataSize;
+    out += sizeof(FLVTag::FLVTagHeader);
+    if (mediaSize)
+        memcpy(out, media, mediaSize);
+    out += mediaSize;
+    if (payloadSize)
+        memcpy(out, payload, payloadSize);
+    out += payloadSize;
+    uint32_t previousTagSize = (uint32_t)(sizeof(FLVTag::FLVTagHeader) + dataSize);
+    out[0] = (uint8_t)(previousTagSize >> 24);
+    out[1] = (uint8_t)(previousTagSize >> 16);
+    out[2] = (uint8_t)(previousTagSize >> 8);
+    out[3] = (uint8_t)previousTagSize;
+
+    SharedTag tag;
+    tag._buffer = buffer;
+    return tag;
+}
+
+const uint8_t* SharedTag::Data() const
+{
+    return _buffer ? _buffer->_data : nullptr;
+}
+
+size_t SharedTag::Size() const
+{
+    return _buffer ? _buffer->_size : 0;
+}
+
+uint8_t SharedTag::Type() const
+{
+    return _buffer ? _buffer->_type : 0;
+}
+
+uint32_t SharedTag::Timestamp() const
+{
+    return _buffer ? _buffer->_timestamp : 0;
+}
+
+bool SharedTag::IsKeyframe() const
+{
+    return _buffer && (_buffer->_flags & kSharedTagKeyframe);
+}
+
+bool SharedTag::IsSequenceHeader() const
+{
+    return _buffer && (_buffer->_flags & kSharedTagSequenceHeader);
+}
+
+FanoutHub::FanoutHub(size_t ringCapacity)
+                : _ringCapacity(ringCapacity < 8 ? 8 : ringCapacity)
+{
+
+}
+
+std::shared_ptr<FanoutConsumer> FanoutHub::AddConsumer(std::function<void()> notify)
+{
+    std::shared_ptr<FanoutConsumer> consumer(new FanoutConsumer(_ringCapacity));
+    // set before Publish() can see the consumer
+    consumer->_notify = std::move(notify);
+    std::lock_guard<std::mutex> lock(_mutex);
+    _consumers.push_back(consumer);
+    return consumer;
+}
+
+void FanoutHub::RemoveConsumer(const std::shared_ptr<FanoutConsumer>& consumer)
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    for (size_t idx = 0; idx < _consumers.size(); idx++)
+    {
+        if (_consumers[idx] == consumer)
+        {
+            _consumers[idx] = _consumers.back();
+            _consumers.pop_back();
+            break;
+        }
+    }
+}
+
+bool FanoutHub::Deliver(FanoutConsumer& consumer, const SharedTag& tag, bool bSyncPoint)
+{
+    if (consumer._bWaitKeyframe)
+    {
+        if (!bSyncPoint)
+            return false;
+        // restart at the sync point with the current configuration
+        size_t needed = 1 + !!_metadata + !!_videoHeader + !!_audioHeader;
+        if (consumer._ring.Free() < needed)
+        {
+            consumer._dropped.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+        if (_metadata)
+            consumer._ring.TryPush(_metadata);
+        if (_videoHeader)
+            consumer._ring.TryPush(_videoHeader);
+        if (_audioHeader)
+            consumer._ring.TryPush(_audioHeader);
+        consumer._ring.TryPush(tag);
+        consumer._bWaitKeyframe = false;
+        return true;
+    }
+    if (!consumer._ring.TryPush(tag))
+    {
+        consumer._dropped.fetch_add(1, std::memory_order_relaxed);
+        consumer._bWaitKeyframe = true;
+        return false;
+    }
+    return true;
+}
+
+void FanoutHub::Publish(const SharedTag& tag)
+{
+    if (!tag)
+        return;
+    if (tag.Type() == TagTypeVideo)
+        _bHasVideo = true;
+    if (tag.IsSequenceHeader())
+    {
+        if (tag.Type() == TagTypeScript)
+            _metadata = tag;
+        else if (tag.Type() == TagTypeVideo)
+            _videoHeader = tag;
+        else
+            _audioHeader = tag;
+    }
+    // audio only streams can be joined at any audio frame
+    bool bSyncPoint = tag.IsKeyframe() ||
+        (!_bHasVideo && tag.Type() == TagTypeAudio && !tag.IsSequenceHeader());
+
+    std::lock_guard<std::mutex> lock(_mutex);
+    for (size_t idx = 0; idx < _consumers.size(); idx++)
+    {
+        FanoutConsumer& consumer = *_consumers[idx];
+        if (Deliver(consumer, tag, bSyncPoint) && consumer._notify)
+            consumer._notify();
+    }
+}
+
+ParsingVideoTag FanoutHub::VideoTagHandler(ParsingVideoTag next)
+{
+    return [this, next](FLVTag* tag, int size, uint32_t preSize,
+                        AVCPacket::AVCPacketHeader* AVCHeader, uint8_t vp6Byte)
+    {
+        const VideoTag* video = static_cast<const VideoTag*>(tag->_data);
+        uint8_t media[kMaxVideoHeaderSize];
+        size_t mediaSize = WriteVideoHeader(*video, AVCHeader, vp6Byte, media);
+        Publish(SharedTag::Create(tag->_header, media, mediaSize, video->_data, size));
+        next(tag, size, preSize, AVCHeader, vp6Byte);
+    };
+}
+
+ParsingAudioTag FanoutHub::AudioTagHandler(ParsingAudioTag next)
+{
+    return [this, next](FLVTag* tag, int size, uint32_t preSize, uint8_t AACPacketType)
+    {
+        const AudioTag* audio = static_cast<const AudioTag*>(tag->_data);
+        uint8_t media[2];
+        size_t mediaSize = 0;
+        memcpy(media, &audio->_header, sizeof(audio->_header));
+        mediaSize += sizeof(audio->_header);
+        if (audio->_header._soundFormat == AAC)
+            media[mediaSize++] = AACPacketType;
+        Publish(SharedTag::Create(tag->_header, media, mediaSize, audio->_data, size));
+        next(tag, size, preSize, AACPacketType);
+    };
+}
+
+ParsingScriptTag FanoutHub::ScriptTagHandler(ParsingScriptTag next)
+{
+    return [this, next](FLVTag* tag, int size, uint32_t preSize)
+    {
+        Publish(SharedTag::Create(tag->_header, nullptr, 0, tag->_data, size));
+        next(tag, size, preSize);
+    };
+}
+
+FLVPARSER_NAMESPACE_END
@@ -0,0 +1,119 @@
+/**
+* This file is part of FLVParser.
+
+* FLVParser is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+
+* FLVParser is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+
+* You should have received a copy of the GNU General Public License
+* along with FLVParser.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef FLVFANOUT_H_
+#define FLVFANOUT_H_
+
+#include "common.h"
+#include "flvparser.h"
+#include "spscring.h"
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+FLVPARSER_NAMESPACE_BEGIN
+
+// Immutable, reference counted copy of one whole tag as it appears in the
+// file: 11 bytes header, DataSize bytes and the 4 bytes PreviousTagSize.
+// Copying the handle only touches the reference count.
+class SharedTag
+{
+public:
+    SharedTag() {}
+    SharedTag(const SharedTag& other);
+    SharedTag(SharedTag&& other) : _buffer(other._buffer) { other._buffer = nullptr; }
+    ~SharedTag();
+
+    SharedTag& operator= (const SharedTag& other);
+    SharedTag& operator= (SharedTag&& other);
+
+    //! media is the AudioTagHeader/VideoTagHeader plus packet header bytes
+    //! that the parser split from the payload
+    static SharedTag    Create(const FLVTag::FLVTagHeader& header,
+                               const void* media, size_t mediaSize,
+                               const void* payload, size_t payloadSize);
+
+    explicit operator bool() const  { return _buffer != nullptr; }
+    const uint8_t*      Data() const;
+    size_t              Size() const;
+    uint8_t             Type() const;
+    uint32_t            Timestamp() const;
+    bool                IsKeyframe() const;         //!< Video keyframe, not a sequence header
+    bool                IsSequenceHeader() const;   //!< AVC/AAC configuration or script data
+
+private:
+    struct Buffer;
+    Buffer*             _buffer { nullptr };
+};
+
+class FanoutConsumer
+{
+public:
+    explicit FanoutConsumer(size_t capacity) : _ring(capacity) {}
+
+    //! Consumer thread only, false when nothing is queued
+    bool                Pop(SharedTag& tag)     { return _ring.TryPop(tag); }
+    size_t              Queued() const          { return _ring.Size(); }
+    uint64_t            Dropped() const         { return _dropped.load(std::memory_order_relaxed); }
+
+private:
+    friend class FanoutHub;
+
+    SpscRing<SharedTag> _ring;
+    std::function<void()> _notify;              //!< Set by AddConsumer(), never changed after
+    std::atomic<uint64_t> _dropped { 0 };
+    bool                _bWaitKeyframe { true };    //!< Producer side: skip until the next sync point
+};
+
+// Fan-out of one parsed stream to many consumers. Every tag is copied once
+// into a SharedTag and the handle is pushed to a lock-free ring per
+// consumer. A consumer whose ring is full loses tags up to the next video
+// keyframe, then gets the cached sequence headers again, so the producer
+// never waits for a slow consumer.
+class FanoutHub
+{
+public:
+    explicit FanoutHub(size_t ringCapacity = 1024);
+
+    //! notify is called on the producer thread after tags were queued for
+    //! the consumer, for example to signal an eventfd; nullptr for polling
+    std::shared_ptr<FanoutConsumer> AddConsumer(std::function<void()> notify = nullptr);
+    void                RemoveConsumer(const std::shared_ptr<FanoutConsumer>& consumer);
+    void                Publish(const SharedTag& tag);
+
+    // Parser callbacks publishing to the hub and then forwarding to next
+    ParsingVideoTag     VideoTagHandler(ParsingVideoTag next = &DoNothingOnVideoTag);
+    ParsingAudioTag     AudioTagHandler(ParsingAudioTag next = &DoNothingOnAudioTag);
+    ParsingScriptTag    ScriptTagHandler(ParsingScriptTag next = &DoNothingOnScriptTag);
+
+private:
+    bool                Deliver(FanoutConsumer& consumer, const SharedTag& tag, bool bSyncPoint);
+
+    size_t              _ringCapacity;
+    std::mutex          _mutex;                     //!< Guards the consumer list only
+    std::vector<std::shared_ptr<FanoutConsumer>> _consumers;
+    SharedTag           _metadata;                  //!< Cached for joining and resyncing consumers
+    SharedTag           _videoHeader;
+    SharedTag           _audioHeader;
+    bool                _bHasVideo  { false };
+};
+
+FLVPARSER_NAMESPACE_END
+
+#endif // FLVFANOUT_H_
@@ -0,0 +1,173 @@
+/**
+* This file is part of FLVParser.
+
+* FLVParser is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+
+* FLVParser is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+
+* You should have received a copy of the GNU General Public License
+* along with FLVParser.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "common.h"
+#include "flvinterleave.h"
+#include "flvreader.h"
+
+#include <algorithm>
+#include <string.h>
+
+FLVPARSER_NAMESPACE_BEGIN
+
+static const size_t kSpareBuffers   = 256;
+static const size_t kSpareBytes     = 1 << 20;
+
+FLVInterleaver::FLVInterleaver(const char* outputFile, const InterleaveOptions& options)
+                : _writer(outputFile),
+                  _options(options)
+{
+    if (_options._maxTags < 1)
+        _options._maxTags = 1;
+}
+
+InterleaveResult FLVInterleaver::Result() const
+{
+    InterleaveResult result = _result;
+    result._bytes = _writer.Tell();
+    result._writeCalls = _writer.WriteCalls();
+    return result;
+}
+
+bool FLVInterleaver::WriteNext()
+{
+    std::pop_heap(_heap.begin(), _heap.end(), Later());
+    HeldTag& held = _heap.back();
+    if (_bWritten && held._timestamp < _lastWritten)
+        _result._lateTags++;
+    else
+        _lastWritten = held._timestamp;
+    _bWritten = true;
+
+    FLVTag::FLVTagHeader header;
+    memcpy(&header, held._data.data(), sizeof(header));
+    bool bOk = _writer.WriteTag(header, held._data.data() + sizeof(header),
+                                held._data.size() - sizeof(header), nullptr, 0);
+    _result._tags++;
+    _heldBytes -= held._data.size();
+    if (_spare.size() < kSpareBuffers && held._data.capacity() <= kSpareBytes)
+        _spare.push_back(std::move(held._data));
+    _heap.pop_back();
+    return bOk;
+}
+
+bool FLVInterleaver::Interleave(const char* inputFile)
+{
+    if (_bRead)
+    {
+        std::cerr << "[failed]: the interleaver already has an input" << std::endl;
+        return false;
+    }
+    _bRead = true;
+    FileReader reader(inputFile);
+    uint8_t header[sizeof(FLVHeader)];
+    if (reader.Read(header, sizeof(header)) != sizeof(header))
+    {
+        std::cerr << "[failed]: " << inputFile << " is too short for a flv header" << std::endl;
+        return false;
+    }
+    if (header[0] != 'F' || header[1] != 'L' || header[2] != 'V')
+    {
+        std::cerr << "[failed]: " << inputFile << " flv header signature is not right" << std::endl;
+        return false;
+    }
+    uint32_t dataOffset = ((uint32_t)header[5] << 24) | (header[6] << 16) | (header[7] << 8) | header[8];
+    // skip the header and PreviousTagSize0
+    if (dataOffset < sizeof(header) || !reader.Seek((uint64_t)dataOffset + sizeof(uint32_t)))
+    {
+        std::cerr << "[failed]: " << inputFile << " flv header data offset is not right" << std::endl;
+        return false;
+    }
+    if (!_writer.WriteHeader(!!(header[4] & 0x04), !!(header[4] & 0x01)))
+        return false;
+
+    while (reader.Tell() < reader.FileSize())
+    {
+        FLVTag::FLVTagHeader tag;
+        if (reader.Read(&tag, sizeof(tag)) != sizeof(tag))
+        {
+            std::cerr << "[warning]: " << inputFile << " ends inside a tag header" << std::endl;
+            break;
+        }
+        uint32_t dataSize = TagDataSize(tag);
+        if (reader.Tell() + dataSize + sizeof(uint32_t) > reader.FileSize())
+        {
+            std::cerr << "[warning]: " << inputFile << " ends inside a tag, the partial tag is dropped" << std::endl;
+            break;
+        }
+        if (tag._tagType != TagTypeAudio && tag._tagType != TagTypeVideo &&
+            tag._tagType != TagTypeScript)
+        {
+            std::cerr << "[failed]: " << inputFile << " unknown flv tag type at offset " <<
+                reader.Tell() - sizeof(tag) << std::endl;
+            return false;
+        }
+
+        HeldTag held;
+        held._timestamp = TagTimestamp(tag);
+        held._sequence = _sequence++;
+        if (!_spare.empty())
+        {
+            held._data = std::move(_spare.back());
+            _spare.pop_back();
+        }
+        held._data.resize(sizeof(tag) + dataSize);
+        memcpy(held._data.data(), &tag, sizeof(tag));
+        if (reader.Read(held._data.data() + sizeof(tag), dataSize) != dataSize ||
+            !reader.Skip(sizeof(uint32_t)))
+        {
+            std::cerr << "[failed]: " << inputFile << " read of a tag failed" << std::endl;
+            return false;
+        }
+
+        // how far back in time this tag is tells the window it needs
+        if (_sequence > 1 && held._timestamp < _maxTimestamp)
+        {
+            _result._reordered++;
+            if (_maxTimestamp - held._timestamp > _result._neededMs)
+                _result._neededMs = _maxTimestamp - held._timestamp;
+        }
+        else
+        {
+            _maxTimestamp = held._timestamp;
+        }
+        _heldBytes += held._data.size();
+        _heap.push_back(std::move(held));
+        std::push_heap(_heap.begin(), _heap.end(), Later());
+        if (_heap.size() > _result._maxHeldTags)
+            _result._maxHeldTags = (uint32_t)_heap.size();
+        if (_heldBytes > _result._maxHeldBytes)
+            _result._maxHeldBytes = _heldBytes;
+
+        // nothing read later can go before a tag more than the window back
+        while (!_heap.empty() &&
+               (_maxTimestamp - _heap.front()._timestamp > _options._windowMs ||
+                _heap.size() > _options._maxTags || _heldBytes > _options._maxBytes))
+        {
+            if (!WriteNext())
+                return false;
+        }
+    }
+    while (!_heap.empty())
+    {
+        if (!WriteNext())
+            return false;
+    }
+    return _writer.Flush();
+}
+
+FLVPARSER_NAMESPACE_END
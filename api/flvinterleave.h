@@ -0,0 +1,94 @@
+/**
+* This file is part of FLVParser.
+
+* FLVParser is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+
+* FLVParser is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+
+* You should have received a copy of the GNU General Public License
+* along with FLVParser.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef FLVINTERLEAVE_H_
+#define FLVINTERLEAVE_H_
+
+#include "common.h"
+#include "flvwriter.h"
+
+#include <vector>
+
+FLVPARSER_NAMESPACE_BEGIN
+
+struct InterleaveOptions
+{
+    uint32_t        _windowMs               { 5000 };       //!< A tag waits until one this much later was read
+    uint32_t        _maxTags                { 1 << 16 };    //!< Hard caps on what is held back
+    uint64_t        _maxBytes               { 256 << 20 };
+};
+
+struct InterleaveResult
+{
+    uint64_t        _tags                   { 0 };          //!< Tags written
+    uint64_t        _reordered              { 0 };          //!< Read after a tag with a later timestamp
+    uint64_t        _lateTags               { 0 };          //!< Still written out of order, the window was too small
+    uint32_t        _neededMs               { 0 };          //!< Smallest _windowMs that sorts the whole file
+    uint32_t        _maxHeldTags            { 0 };          //!< Peak window actually used
+    uint64_t        _maxHeldBytes           { 0 };
+    uint64_t        _bytes                  { 0 };          //!< Output size
+    uint64_t        _writeCalls             { 0 };
+};
+
+// Rewrites an FLV file with its tags in timestamp order. Tags are held in a
+// min-heap until a tag _windowMs later has been read, so the memory used
+// depends on the window and not on the file size; ties keep the input
+// order. A tag arriving later than the window allows is written at once
+// and counted in _lateTags, _neededMs tells the window that would have
+// been enough.
+class FLVInterleaver
+{
+public:
+    FLVInterleaver(const char* outputFile, const InterleaveOptions& options = InterleaveOptions());
+
+    //! One input per interleaver, the output is flushed at the end
+    bool                Interleave(const char* inputFile);
+    InterleaveResult    Result() const;
+
+private:
+    struct HeldTag
+    {
+        uint32_t                _timestamp      { 0 };
+        uint64_t                _sequence       { 0 };  //!< Input order, breaks ties
+        std::vector<uint8_t>    _data;                  //!< Tag header and DataSize bytes
+    };
+    struct Later
+    {
+        bool operator() (const HeldTag& a, const HeldTag& b) const
+        {
+            return a._timestamp != b._timestamp ? a._timestamp > b._timestamp : a._sequence > b._sequence;
+        }
+    };
+
+    bool                WriteNext();
+
+    FLVWriter           _writer;
+    InterleaveOptions   _options;
+    InterleaveResult    _result;
+    std::vector<HeldTag> _heap;
+    std::vector<std::vector<uint8_t>> _spare;       //!< Buffers of written tags, reused
+    uint64_t            _heldBytes      { 0 };
+    uint64_t            _sequence       { 0 };
+    uint32_t            _maxTimestamp   { 0 };      //!< Latest timestamp read
+    uint32_t            _lastWritten    { 0 };      //!< Latest timestamp written
+    bool                _bRead          { false };
+    bool                _bWritten       { false };
+};
+
+FLVPARSER_NAMESPACE_END
+
+#endif // FLVINTERLEAVE_H_
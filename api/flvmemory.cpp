@@ -0,0 +1,125 @@
+/**
+* This file is part of FLVParser.
+
+* FLVParser is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+
+* FLVParser is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+
+* You should have received a copy of the GNU General Public License
+* along with FLVParser.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "common.h"
+#include "flvmemory.h"
+
+#include <new>
+#include <stdlib.h>
+
+FLVPARSER_NAMESPACE_BEGIN
+
+class GlobalHeapResource : public MemoryResource
+{
+protected:
+    void* DoAllocate(size_t bytes, size_t alignment) override
+    {
+        if (alignment <= kMaxAlign)
+            return ::operator new(bytes);
+        void* p = nullptr;
+        if (posix_memalign(&p, alignment, bytes) != 0)
+            throw std::bad_alloc();
+        return p;
+    }
+
+    void DoDeallocate(void* p, size_t, size_t alignment) override
+    {
+        if (alignment <= kMaxAlign)
+            ::operator delete(p);
+        else
+            free(p);
+    }
+};
+
+MemoryResource* HeapResource()
+{
+    static GlobalHeapResource resource;
+    return &resource;
+}
+
+MonotonicResource::MonotonicResource(size_t blockSize, MemoryResource* upstream)
+                : _upstream(upstream ? upstream : HeapResource()),
+                  _blockSize(blockSize < 1024 ? 1024 : blockSize)
+{
+
+}
+
+MonotonicResource::~MonotonicResource()
+{
+    Release();
+}
+
+void MonotonicResource::Release()
+{
+    while (_blocks)
+    {
+        Block* next = _blocks->_next;
+        _upstream->Deallocate(_blocks, _blocks->_size, _blocks->_alignment);
+        _blocks = next;
+    }
+    _current = nullptr;
+    _left = 0;
+    _reserved = 0;
+}
+
+void* MonotonicResource::DoAllocate(size_t bytes, size_t alignment)
+{
+    size_t padding = (alignment - ((uintptr_t)_current & (alignment - 1))) & (alignment - 1);
+    if (!_current || padding + bytes > _left)
+    {
+        // the block itself is aligned for the request, so the rounded up
+        // header leaves _current aligned and no padding is needed below
+        size_t blockAlignment = alignment > kMaxAlign ? alignment : kMaxAlign;
+        size_t header = (sizeof(Block) + alignment - 1) & ~(alignment - 1);
+        size_t size = _blockSize;
+        while (size < header + bytes)
+            size *= 2;
+        Block* block = static_cast<Block*>(_upstream->Allocate(size, blockAlignment));
+        block->_next = _blocks;
+        block->_size = size;
+        block->_alignment = blockAlignment;
+        _blocks = block;
+        _reserved += size;
+        _current = reinterpret_cast<uint8_t*>(block) + header;
+        _left = size - header;
+        _blockSize = size * 2;
+        padding = (alignment - ((uintptr_t)_current & (alignment - 1))) & (alignment - 1);
+    }
+    void* p = _current + padding;
+    _current += padding + bytes;
+    _left -= padding + bytes;
+    return p;
+}
+
+void* CountingResource::DoAllocate(size_t bytes, size_t alignment)
+{
+    void* p = _upstream->Allocate(bytes, alignment);
+    _allocations.fetch_add(1, std::memory_order_relaxed);
+    uint64_t inUse = _inUse.fetch_add(bytes, std::memory_order_relaxed) + bytes;
+    uint64_t peak = _peak.load(std::memory_order_relaxed);
+    while (inUse > peak && !_peak.compare_exchange_weak(peak, inUse, std::memory_order_relaxed))
+        ;
+    return p;
+}
+
+void CountingResource::DoDeallocate(void* p, size_t bytes, size_t alignment)
+{
+    _upstream->Deallocate(p, bytes, alignment);
+    _inUse.fetch_sub(bytes, std::memory_order_relaxed);
+}
+
+FLVPARSER_NAMESPACE_END
@@ -0,0 +1,190 @@
+/**
+* This file is part of FLVParser.
+
+* FLVParser is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+
+* FLVParser is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+
+* You should have received a copy of the GNU General Public License
+* along with FLVParser.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef FLVMEMORY_H_
+#define FLVMEMORY_H_
+
+#include "common.h"
+
+#include <atomic>
+#include <cstddef>
+
+FLVPARSER_NAMESPACE_BEGIN
+
+static const size_t kMaxAlign = alignof(std::max_align_t);
+
+// Where a parser takes its memory from: tag payload buffers, read blocks
+// and the script data tree. It plays the role of std::pmr::memory_resource
+// for this C++11 code base; allocation failures throw std::bad_alloc.
+class MemoryResource
+{
+public:
+    virtual ~MemoryResource() {}
+
+    void*               Allocate(size_t bytes, size_t alignment = kMaxAlign)
+    {
+        return DoAllocate(bytes, alignment);
+    }
+
+    void                Deallocate(void* p, size_t bytes, size_t alignment = kMaxAlign)
+    {
+        DoDeallocate(p, bytes, alignment);
+    }
+
+protected:
+    virtual void*       DoAllocate(size_t bytes, size_t alignment) = 0;
+    virtual void        DoDeallocate(void* p, size_t bytes, size_t alignment) = 0;
+};
+
+//! The global heap, used whenever no resource is given
+MemoryResource*         HeapResource();
+
+// Arena for one request or one stream: allocations are carved out of
+// blocks taken from upstream, Deallocate() does nothing and Release()
+// returns every block at once. Not thread safe.
+class MonotonicResource : public MemoryResource
+{
+public:
+    explicit MonotonicResource(size_t blockSize = 64 << 10, MemoryResource* upstream = HeapResource());
+    ~MonotonicResource();
+
+    MonotonicResource(const MonotonicResource&)             = delete;
+    MonotonicResource& operator= (const MonotonicResource&) = delete;
+
+    void                Release();
+    size_t              Reserved() const    { return _reserved; }   //!< Bytes taken from upstream
+
+protected:
+    void*               DoAllocate(size_t bytes, size_t alignment) override;
+    void                DoDeallocate(void*, size_t, size_t) override {}
+
+private:
+    struct Block
+    {
+        Block*          _next;
+        size_t          _size;
+        size_t          _alignment;             //!< Requested from upstream, returned with it
+    };
+
+    MemoryResource*     _upstream;
+    size_t              _blockSize;             //!< Size of the next block, doubles every block
+    Block*              _blocks     { nullptr };
+    uint8_t*            _current    { nullptr };
+    size_t              _left       { 0 };
+    size_t              _reserved   { 0 };
+};
+
+// Forwards to upstream and accounts for every byte, can be shared by
+// parsers on several threads
+class CountingResource : public MemoryResource
+{
+public:
+    explicit CountingResource(MemoryResource* upstream = HeapResource()) : _upstream(upstream) {}
+
+    uint64_t            InUse() const       { return _inUse.load(std::memory_order_relaxed); }
+    uint64_t            Peak() const        { return _peak.load(std::memory_order_relaxed); }
+    uint64_t            Allocations() const { return _allocations.load(std::memory_order_relaxed); }
+
+protected:
+    void*               DoAllocate(size_t bytes, size_t alignment) override;
+    void                DoDeallocate(void* p, size_t bytes, size_t alignment) override;
+
+private:
+    MemoryResource*     _upstream;
+    std::atomic<uint64_t> _inUse        { 0 };
+    std::atomic<uint64_t> _peak         { 0 };
+    std::atomic<uint64_t> _allocations  { 0 };
+};
+
+// Standard allocator over a resource, for the containers the parser uses
+template <typename T>
+class ResourceAllocator
+{
+public:
+    typedef T value_type;
+
+    ResourceAllocator(MemoryResource* resource) : _resource(resource) {}
+    template <typename U>
+    ResourceAllocator(const ResourceAllocator<U>& other) : _resource(other.Resource()) {}
+
+    T*                  allocate(size_t count)
+    {
+        return static_cast<T*>(_resource->Allocate(count * sizeof(T), alignof(T)));
+    }
+
+    void                deallocate(T* p, size_t count)
+    {
+        _resource->Deallocate(p, count * sizeof(T), alignof(T));
+    }
+
+    MemoryResource*     Resource() const    { return _resource; }
+
+private:
+    MemoryResource*     _resource;
+};
+
+template <typename T, typename U>
+bool operator== (const ResourceAllocator<T>& a, const ResourceAllocator<U>& b)
+{
+    return a.Resource() == b.Resource();
+}
+
+template <typename T, typename U>
+bool operator!= (const ResourceAllocator<T>& a, const ResourceAllocator<U>& b)
+{
+    return a.Resource() != b.Resource();
+}
+
+// Byte buffer that goes back to the resource it was allocated from
+class ResourceBuffer
+{
+public:
+    ResourceBuffer() {}
+    ~ResourceBuffer()                       { Reset(); }
+
+    ResourceBuffer(const ResourceBuffer&)               = delete;
+    ResourceBuffer& operator= (const ResourceBuffer&)   = delete;
+
+    //! Drops the old contents
+    void                Allocate(MemoryResource* resource, size_t size)
+    {
+        Reset();
+        _data = static_cast<uint8_t*>(resource->Allocate(size));
+        _resource = resource;
+        _size = size;
+    }
+
+    void                Reset()
+    {
+        if (_data)
+            _resource->Deallocate(_data, _size);
+        _data = nullptr;
+        _size = 0;
+    }
+
+    uint8_t*            Get() const         { return _data; }
+    size_t              Size() const        { return _size; }
+
+private:
+    MemoryResource*     _resource   { nullptr };
+    uint8_t*            _data       { nullptr };
+    size_t              _size       { 0 };
+};
+
+FLVPARSER_NAMESPACE_END
+
+#endif // FLVMEMORY_H_
@@ -17,21 +17,201 @@
 
 #include "common.h"
 #include "flvparser.h"
+#include "flvamf0.h"
+#include "spscring.h"
 
 #include <string.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
 #include <memory>
+#include <mutex>
+#include <thread>
 #include <vector>
 
 FLVPARSER_NAMESPACE_BEGIN
 
+#ifdef FLVPARSER_ENABLE_STATS
+// Adds the lifetime of the scope to a nanosecond counter
+class ScopedTimer
+{
+public:
+    explicit ScopedTimer(uint64_t& counter)
+        : _counter(counter), _start(std::chrono::steady_clock::now()) {}
+    ~ScopedTimer()
+    {
+        _counter += std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now() - _start).count();
+    }
+
+private:
+    uint64_t&                               _counter;
+    std::chrono::steady_clock::time_point   _start;
+};
+#endif // FLVPARSER_ENABLE_STATS
+
+// Blocks one side of a SpscRing until the other side made progress. It spins
+// a little first and only pays for the condition variable while asleep.
+class RingWaiter
+{
+public:
+    template <typename Ready>
+    void Wait(Ready ready)
+    {
+        for (int spin = 0; spin < 64; spin++)
+        {
+            if (ready())
+                return;
+            std::this_thread::yield();
+        }
+        std::unique_lock<std::mutex> lock(_mutex);
+        _sleepers.fetch_add(1);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        while (!ready())
+            _cond.wait_for(lock, std::chrono::milliseconds(10));
+        _sleepers.fetch_sub(1);
+    }
+
+    void Notify()
+    {
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (_sleepers.load(std::memory_order_relaxed))
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _cond.notify_one();
+        }
+    }
+
+private:
+    std::mutex              _mutex;
+    std::condition_variable _cond;
+    std::atomic<int>        _sleepers { 0 };
+};
+
 void DoNothingOnFLVHeader(FLVHeader*, uint32_t) {}
 void DoNothingOnVideoTag(FLVTag*, int, uint32_t, AVCPacket::AVCPacketHeader*, uint8_t) {}
 void DoNothingOnAudioTag(FLVTag*, int, uint32_t, uint8_t) {}
 void DoNothingOnScriptTag(FLVTag*, int, uint32_t) {}
 
-ScriptKVDataParser::ScriptKVDataParser(FLVTag* scriptTag, int size)
+static inline int32_t ReadSI24(const uint8_t* bytes)
+{
+    return (int32_t)(((uint32_t)bytes[0] << 24) | (bytes[1] << 16) | (bytes[2] << 8)) >> 8;
+}
+
+bool ParseVideoHeader(const uint8_t* data, size_t size, VideoHeaderInfo& info)
+{
+    info = VideoHeaderInfo();
+    if (size < 1)
+        return false;
+    info._frameType = (data[0] >> 4) & 0x07;
+    info._bEnhanced = (data[0] & 0x80) != 0;
+    info._headerSize = 1;
+    if (info._bEnhanced)
+    {
+        info._packetType = data[0] & 0x0F;
+        // multitrack and ModEx packets of later revisions are laid out differently
+        if (info._packetType <= VideoPacketMPEG2TSSequenceStart)
+        {
+            if (size < 5)
+                return false;
+            info._fourCC = ((uint32_t)data[1] << 24) | (data[2] << 16) | (data[3] << 8) | data[4];
+            info._headerSize = 5;
+            info._bSequenceHeader = info._packetType == VideoPacketSequenceStart;
+            info._bCodedFrame = info._packetType == VideoPacketCodedFrames ||
+                                info._packetType == VideoPacketCodedFramesX;
+            if (info._fourCC == FourCCHEVC && info._packetType == VideoPacketCodedFrames)
+            {
+                if (size < 8)
+                    return false;
+                info._compositionTime = ReadSI24(data + 5);
+                info._headerSize = 8;
+            }
+        }
+    }
+    else
+    {
+        info._codecID = data[0] & 0x0F;
+        info._bCodedFrame = true;
+        if (info._codecID == AVC)
+        {
+            if (size < 5)
+                return false;
+            info._packetType = data[1];
+            info._compositionTime = ReadSI24(data + 2);
+            info._headerSize = 5;
+            info._bSequenceHeader = info._packetType == AVCSequenceHeader;
+            info._bCodedFrame = info._packetType == AVCNALU;
+        }
+        else if (info._codecID == VP6 || info._codecID == VP6WithAlpha)
+        {
+            if (size < 2)
+                return false;
+            info._headerSize = 2;
+        }
+    }
+    // video info and command frames carry no picture
+    if (info._frameType == VideoInfo)
+        info._bCodedFrame = false;
+    return true;
+}
+
+size_t WriteVideoHeader(const VideoTag& video, const AVCPacket::AVCPacketHeader* AVCHeader,
+                        uint8_t vp6Byte, uint8_t* out)
+{
+    size_t size = sizeof(video._header);
+    memcpy(out, &video._header, sizeof(video._header));
+    if (IsExVideoHeader(video._header))
+    {
+        uint8_t packetType = video._header._codecID;
+        if (packetType > VideoPacketMPEG2TSSequenceStart)
+            return size;
+        out[size++] = (uint8_t)(video._fourCC >> 24);
+        out[size++] = (uint8_t)(video._fourCC >> 16);
+        out[size++] = (uint8_t)(video._fourCC >> 8);
+        out[size++] = (uint8_t)video._fourCC;
+        if (video._fourCC == FourCCHEVC && packetType == VideoPacketCodedFrames && AVCHeader)
+        {
+            memcpy(out + size, AVCHeader->_compositionTime, sizeof(AVCHeader->_compositionTime));
+            size += sizeof(AVCHeader->_compositionTime);
+        }
+    }
+    else if (video._header._codecID == AVC && AVCHeader)
+    {
+        memcpy(out + size, AVCHeader, sizeof(*AVCHeader));
+        size += sizeof(*AVCHeader);
+    }
+    else if (video._header._codecID == VP6 || video._header._codecID == VP6WithAlpha)
+    {
+        out[size++] = vp6Byte;
+    }
+    return size;
+}
+
+// sequence headers and coded frames as seen through the parsed headers
+static bool IsVideoSequenceHeader(const VideoTag::VideoTagHeader& video,
+                                  const AVCPacket::AVCPacketHeader& AVCHeader)
+{
+    if (IsExVideoHeader(video))
+        return video._codecID == VideoPacketSequenceStart;
+    return video._codecID == AVC && AVCHeader._AVCPacketType == AVCSequenceHeader;
+}
+
+static bool IsVideoCodedFrame(const VideoTag::VideoTagHeader& video,
+                              const AVCPacket::AVCPacketHeader& AVCHeader)
+{
+    if (VideoFrameType(video) == VideoInfo)
+        return false;
+    if (IsExVideoHeader(video))
+        return video._codecID == VideoPacketCodedFrames || video._codecID == VideoPacketCodedFramesX;
+    return video._codecID != AVC || AVCHeader._AVCPacketType == AVCNALU;
+}
+
+ScriptKVDataParser::ScriptKVDataParser(FLVTag* scriptTag, int size, MemoryResource* resource)
                 : _scriptTag(scriptTag),
-                  _size(size)
+                  _size(size),
+                  _resource(resource ? resource : HeapResource())
 {
 
 }
@@ -47,56 +227,67 @@ void ScriptKVDataParser::Free()
     // Free the parsing tree memory
     if (_scriptTagBody)
     {
-        FreeData(_scriptTagBody, true);
-        delete _scriptTagBody;
+        FreeNode(_scriptTagBody, true);
         _scriptTagBody = nullptr;
     }
 }
 
+char* ScriptKVDataParser::CreateString(const uint8_t* data, uint32_t length)
+{
+    // the length goes in front so the string can be given back with its size
+    uint8_t* block = static_cast<uint8_t*>(_resource->Allocate(sizeof(uint32_t) + length + 1, alignof(uint32_t)));
+    memcpy(block, &length, sizeof(uint32_t));
+    char* str = (char*)(block + sizeof(uint32_t));
+    memcpy(str, data, length * sizeof(char));
+    str[length] = '\0';
+    return str;
+}
+
+void ScriptKVDataParser::DestroyString(char* str)
+{
+    uint8_t* block = (uint8_t*)str - sizeof(uint32_t);
+    uint32_t length;
+    memcpy(&length, block, sizeof(uint32_t));
+    _resource->Deallocate(block, sizeof(uint32_t) + length + 1, alignof(uint32_t));
+}
+
+ScriptData* ScriptKVDataParser::CreateArray(uint32_t count)
+{
+    ScriptData* dataArray = static_cast<ScriptData*>(
+        _resource->Allocate(count * sizeof(ScriptData), alignof(ScriptData)));
+    for (uint32_t idx = 0; idx < count; idx++)
+        new (&dataArray[idx]) ScriptData;
+    return dataArray;
+}
+
+void ScriptKVDataParser::FreeNode(ScriptData* data, bool bKey)
+{
+    if (!data)
+        return;
+    FreeData(data, bKey);
+    Destroy(data);
+}
+
+// Releases what the node owns but not the node itself, a key owns its value
 void ScriptKVDataParser::FreeData(ScriptData* data, bool bKey)
 {
     switch (data->_type)
     {
     case DOUBLE:
-    {
-        double* p = (double*)data->_data;
-        delete p;
-        if (bKey)
-            FreeData(data->_value, false);
-    }
+        Destroy((double*)data->_data);
         break;
     case BOOLEAN:
-    {
-        bool* p = (bool*)data->_data;
-        delete p;
-        if (bKey)
-            FreeData(data->_value, false);
-    }
+        Destroy((bool*)data->_data);
         break;
     case REFERENCE:
-    {
-        uint16_t* p = (uint16_t*)data->_data;
-        delete p;
-        if (bKey)
-            FreeData(data->_value, false);
-    }
+        Destroy((uint16_t*)data->_data);
         break;
     case DATA_DATE:
-    {
-        uint64_t* p = (uint64_t*)data->_data;
-        delete p;
-        if (bKey)
-            FreeData(data->_value, false);
-    }
+        Destroy((ScriptDataDate*)data->_data);
         break;
     case STRING:
     case LONG_STRING:
-    {
-        char* str = (char*)data->_data;
-        delete [] str;
-        if (bKey)
-            FreeData(data->_value, false);
-    }
+        DestroyString((char*)data->_data);
         break;
     case MOVIE_CLIP:
     case NULL_DATA:
@@ -108,20 +299,24 @@ void ScriptKVDataParser::FreeData(ScriptData* data, bool bKey)
     case OBJECT:
     {
         int ArrayLength = *(int*)data->_extra;
-        delete &ArrayLength;
+        Destroy((int*)data->_extra);
         ScriptData* dataArray = (ScriptData*)data->_data;
+        // object members are key/value pairs, strict array items are values
         for (int idx = 0; idx < ArrayLength; idx++)
         {
-            FreeData(&dataArray[idx], true);
+            FreeData(&dataArray[idx], data->_type != STRICT_ARRAY);
         }
-        delete[] dataArray;
-        delete data;
+        _resource->Deallocate(dataArray, ArrayLength * sizeof(ScriptData), alignof(ScriptData));
+        // the next top level value
+        FreeNode(data->_value, true);
     }
-        break;
+        return;
     default:
         assert(0);
         break;
     }
+    if (bKey)
+        FreeNode(data->_value, false);
 }
 
 bool ScriptKVDataParser::Parse()
@@ -139,6 +334,7 @@ bool ScriptKVDataParser::Parse()
 
 void ScriptKVDataParser::ParseScriptTagBody(int& offset, ScriptData*& scriptTagBody, bool bKey)
 {
+    scriptTagBody = nullptr;
     if (offset >= _size)
         return;
     uint8_t* data = static_cast<uint8_t*>(_scriptTag->_data);
@@ -163,9 +359,9 @@ void ScriptKVDataParser::ParseScriptTagBody(int& offset, ScriptData*& scriptTagB
         double value = *(double*)(data + offset);
 #endif
         offset += sizeof(double);
-        scriptTagBody = new ScriptData;
+        scriptTagBody = Create(ScriptData());
         scriptTagBody->_type = type;
-        scriptTagBody->_data = (void*)(new double(value));
+        scriptTagBody->_data = (void*)Create(value);
         if (bKey)
             ParseScriptTagBody(offset, scriptTagBody->_value, false);
     }
@@ -175,9 +371,9 @@ void ScriptKVDataParser::ParseScriptTagBody(int& offset, ScriptData*& scriptTagB
         uint8_t value = *(uint8_t*)(data + offset);
         bool v = (value != 0);
         offset += sizeof(uint8_t);
-        scriptTagBody = new ScriptData;
+        scriptTagBody = Create(ScriptData());
         scriptTagBody->_type = type;
-        scriptTagBody->_data = (void*)(new bool(v));
+        scriptTagBody->_data = (void*)Create(v);
         if (bKey)
             ParseScriptTagBody(offset, scriptTagBody->_value, false);
     }
@@ -192,11 +388,9 @@ void ScriptKVDataParser::ParseScriptTagBody(int& offset, ScriptData*& scriptTagB
         uint16_t stringLength = *(uint16_t*)(data + offset);
 #endif
         offset += sizeof(uint16_t);
-        char* str = new char[stringLength + 1];
-        memcpy(str, data + offset, stringLength * sizeof(char));
+        char* str = CreateString(data + offset, stringLength);
         offset += stringLength;
-        str[stringLength] = '\0';
-        scriptTagBody = new ScriptData;
+        scriptTagBody = Create(ScriptData());
         scriptTagBody->_type = type;
         scriptTagBody->_data = (void*)str;
         if (bKey)
@@ -205,9 +399,10 @@ void ScriptKVDataParser::ParseScriptTagBody(int& offset, ScriptData*& scriptTagB
         break;
     case OBJECT: // Object (dose not have the length)
     {
-        std::vector<ScriptData*> objs;
-        scriptTagBody = new ScriptData;
+        std::vector<ScriptData, ResourceAllocator<ScriptData>> objs(_resource);
+        scriptTagBody = Create(ScriptData());
         scriptTagBody->_type = type;
+        _depth++;
         while (1)
         {
 #if PARSER_ENDIAN == PARSER_LITTLEENDIAN
@@ -218,14 +413,12 @@ void ScriptKVDataParser::ParseScriptTagBody(int& offset, ScriptData*& scriptTagB
             uint16_t stringLength = *(uint16_t*)(data + offset);
 #endif
             offset += sizeof(uint16_t);
-            char* str = new char[stringLength + 1];
-            memcpy(str, data + offset, stringLength * sizeof(char));
+            char* str = CreateString(data + offset, stringLength);
             offset += stringLength;
-            str[stringLength] = '\0';
-            ScriptData* sd = new ScriptData;
-            sd->_type = 2;
-            sd->_data = (void*)str;
-            ParseScriptTagBody(offset, sd->_value, false);
+            ScriptData sd;
+            sd._type = 2;
+            sd._data = (void*)str;
+            ParseScriptTagBody(offset, sd._value, false);
             objs.push_back(sd);
 
             // detect the end
@@ -237,15 +430,17 @@ void ScriptKVDataParser::ParseScriptTagBody(int& offset, ScriptData*& scriptTagB
                 break;
             }
         }
-        ScriptData* dataArray = new ScriptData[objs.size()];
+        _depth--;
+        ScriptData* dataArray = CreateArray(objs.size());
         for (size_t idx = 0; idx < objs.size(); idx++)
         {
-            dataArray[idx] = *objs[idx];
-            delete objs[idx];
+            dataArray[idx] = objs[idx];
         }
         scriptTagBody->_data = (void*)dataArray;
-        scriptTagBody->_extra = new int(objs.size());
-        ParseScriptTagBody(offset, scriptTagBody->_value, true);
+        scriptTagBody->_extra = Create((int)objs.size());
+        // only the top level goes on with the next value
+        if (_depth == 0)
+            ParseScriptTagBody(offset, scriptTagBody->_value, true);
     }
         break;
     case MOVIE_CLIP: // MovieClip (reserved, not supported)
@@ -262,9 +457,9 @@ void ScriptKVDataParser::ParseScriptTagBody(int& offset, ScriptData*& scriptTagB
         uint16_t value = *(uint16_t*)(data + offset);
 #endif
         offset += sizeof(uint16_t);
-        scriptTagBody = new ScriptData;
+        scriptTagBody = Create(ScriptData());
         scriptTagBody->_type = type;
-        scriptTagBody->_data = (void*)(new uint16_t(value));
+        scriptTagBody->_data = (void*)Create(value);
         if (bKey)
             ParseScriptTagBody(offset, scriptTagBody->_value, false);
     }
@@ -281,11 +476,12 @@ void ScriptKVDataParser::ParseScriptTagBody(int& offset, ScriptData*& scriptTagB
         uint32_t ECMAArrayLength = *(uint32_t*)(data + offset);
 #endif
         offset += sizeof(uint32_t);
-        ScriptData* dataArray = new ScriptData[ECMAArrayLength];
-        scriptTagBody = new ScriptData;
+        ScriptData* dataArray = CreateArray(ECMAArrayLength);
+        scriptTagBody = Create(ScriptData());
         scriptTagBody->_type = type;
-        scriptTagBody->_extra = new int(ECMAArrayLength);
+        scriptTagBody->_extra = Create((int)ECMAArrayLength);
         scriptTagBody->_data = (void*)dataArray;
+        _depth++;
         for (uint32_t idx = 0; idx < ECMAArrayLength; idx++)
         {
 #if PARSER_ENDIAN == PARSER_LITTLEENDIAN
@@ -296,20 +492,20 @@ void ScriptKVDataParser::ParseScriptTagBody(int& offset, ScriptData*& scriptTagB
             uint16_t stringLength = *(uint16_t*)(data + offset);
 #endif
             offset += sizeof(uint16_t);
-            char* str = new char[stringLength + 1];
-            memcpy(str, data + offset, stringLength * sizeof(char));
+            char* str = CreateString(data + offset, stringLength);
             offset += stringLength;
-            str[stringLength] = '\0';
             dataArray[idx]._type = 2;
             dataArray[idx]._data = (void*)str;
             ParseScriptTagBody(offset, dataArray[idx]._value, false);
         }
+        _depth--;
         // ObjectEndMarker
         uint8_t end0 = (data + offset)[0]; // 0
         uint8_t end1 = (data + offset)[1]; // 0
         uint8_t end2 = (data + offset)[2]; // 9
         offset += 3;
-        ParseScriptTagBody(offset, scriptTagBody->_value, true);
+        if (_depth == 0)
+            ParseScriptTagBody(offset, scriptTagBody->_value, true);
     }
         break;
     case OBJECT_END_MARKER: // Object end marker
@@ -332,18 +528,27 @@ void ScriptKVDataParser::ParseScriptTagBody(int& offset, ScriptData*& scriptTagB
         uint32_t StrictArrayLength = *(uint32_t*)(data + offset);
 #endif
         offset += sizeof(uint32_t);
-        std::vector<ScriptData*> dataVector(StrictArrayLength);
-        ScriptData* dataArray = new ScriptData[StrictArrayLength];
-        scriptTagBody = new ScriptData;
+        ScriptData* dataArray = CreateArray(StrictArrayLength);
+        scriptTagBody = Create(ScriptData());
         scriptTagBody->_type = type;
-        scriptTagBody->_extra = new int(StrictArrayLength);
+        scriptTagBody->_extra = Create((int)StrictArrayLength);
+        _depth++;
         for (uint32_t idx = 0; idx < StrictArrayLength; idx++)
         {
             ScriptData* dataValue;
             ParseScriptTagBody(offset, dataValue, false);
-            dataArray[idx] = *dataValue;
-            delete dataValue;
+            // null and undefined items have no node
+            if (dataValue)
+            {
+                dataArray[idx] = *dataValue;
+                Destroy(dataValue);
+            }
+            else
+            {
+                dataArray[idx]._type = NULL_DATA;
+            }
         }
+        _depth--;
         scriptTagBody->_data = (void*)dataArray;
     }
         break;
@@ -373,10 +578,11 @@ void ScriptKVDataParser::ParseScriptTagBody(int& offset, ScriptData*& scriptTagB
         int16_t timeOffset = *(int16_t*)(data + offset);
 #endif
         offset += sizeof(int16_t);
-        ScriptDataDate* dataDate = new ScriptDataDate;
-        dataDate->_dateTime = dataTime;
-        dataDate->_localDateTimeOffset = timeOffset;
-        scriptTagBody = new ScriptData;
+        ScriptDataDate date;
+        date._dateTime = dataTime;
+        date._localDateTimeOffset = timeOffset;
+        ScriptDataDate* dataDate = Create(date);
+        scriptTagBody = Create(ScriptData());
         scriptTagBody->_type = type;
         scriptTagBody->_data = (void*)dataDate;
         if (bKey)
@@ -395,11 +601,9 @@ void ScriptKVDataParser::ParseScriptTagBody(int& offset, ScriptData*& scriptTagB
         uint32_t stringLength = *(uint32_t*)(data + offset);
 #endif
         offset += sizeof(uint32_t);
-        char* str = new char[stringLength + 1];
-        memcpy(str, data + offset, stringLength * sizeof(char));
+        char* str = CreateString(data + offset, stringLength);
         offset += stringLength;
-        str[stringLength] = '\0';
-        scriptTagBody = new ScriptData;
+        scriptTagBody = Create(ScriptData());
         scriptTagBody->_type = type;
         scriptTagBody->_data = (void*)str;
         if (bKey)
@@ -413,46 +617,114 @@ void ScriptKVDataParser::ParseScriptTagBody(int& offset, ScriptData*& scriptTagB
 }
 
 FLVParser::FLVParser(const char* inputFile,
+                     ParsingFLVHeader pH,
+                     ParsingVideoTag pV,
+                     ParsingAudioTag pA,
+                     ParsingScriptTag pS)
+                     : FLVParser(inputFile, ReadOptions(), pH, pV, pA, pS)
+{
+
+}
+
+FLVParser::FLVParser(const char* inputFile,
+                     const ReadOptions& readOptions,
                      ParsingFLVHeader pH,
                      ParsingVideoTag pV,
                      ParsingAudioTag pA,
                      ParsingScriptTag pS)
                      : _pH(pH), _pV(pV), _pA(pA), _pS(pS)
 {
-    if (_flvFile || !inputFile)
+    if (!inputFile)
     {
         std::cerr << "[failed]: input flv key is null or the flv handler is exist" << std::endl;
         throw "[failed]";
     }
-    _flvFile = fopen(inputFile, "rb");
-    if (!_flvFile)
+    _fileReader.reset(new FileReader(inputFile, readOptions));
+    _reader = _fileReader.get();
+    if (readOptions._resource)
+        _resource = readOptions._resource;
+}
+
+FLVParser::FLVParser(ByteSource* source,
+                     ParsingFLVHeader pH,
+                     ParsingVideoTag pV,
+                     ParsingAudioTag pA,
+                     ParsingScriptTag pS)
+                     : _pH(pH), _pV(pV), _pA(pA), _pS(pS), _reader(source)
+{
+    if (!source)
     {
-        std::cerr << "[failed]: could not open the " << inputFile <<
-            " maybe the file location is invalid" << std::endl;
-        throw "[failed]: throw exception";
+        std::cerr << "[failed]: input byte source is null" << std::endl;
+        throw "[failed]";
     }
 }
 
-FLVParser::~FLVParser()
+// Tag records cycle between the reader thread and the callbacks: free
+// records go to the reader, parsed ones come back in file order.
+struct FLVParser::TagPipeline
 {
-    if (_flvFile)
+    explicit TagPipeline(size_t depth)
+        : _parsed(depth), _free(depth), _records(_parsed.Capacity())
     {
-        fclose(_flvFile);
-        _flvFile = nullptr;
+        // created with a plain new, which C++11 only aligns to max_align_t
+        static_assert(alignof(TagPipeline) <= alignof(std::max_align_t),
+                      "TagPipeline must not be over-aligned");
+        for (size_t idx = 0; idx < _records.size(); idx++)
+            _free.TryPush(&_records[idx]);
     }
+
+    SpscRing<TagRecord*>    _parsed;
+    SpscRing<TagRecord*>    _free;
+    std::vector<TagRecord>  _records;
+    RingWaiter              _parsedWaiter;      //!< The callbacks wait here
+    RingWaiter              _freeWaiter;        //!< The reader waits here
+    std::atomic<bool>       _bStop          { false };
+    std::atomic<bool>       _bFailed        { false };
+    std::atomic<size_t>     _maxQueued      { 0 };
+    std::atomic<uint64_t>   _readerWaits    { 0 };
+    std::atomic<uint64_t>   _callbackWaits  { 0 };
+};
+
+FLVParser::~FLVParser()
+{
+
+}
+
+ReadBackend FLVParser::Backend() const
+{
+    return _fileReader ? _fileReader->Backend() : ReadBackendPread;
+}
+
+ParserCounters FLVParser::Counters() const
+{
+    ParserCounters counters = _counters;
+    counters._readCalls = _reader->ReadCalls() - _readCallsBase;
+    return counters;
+}
+
+void FLVParser::ResetCounters()
+{
+    _counters = ParserCounters();
+    _readCallsBase = _reader->ReadCalls();
 }
 
 bool FLVParser::Parse()
 {
-    if (_flvFile)
+    if (_reader)
     {
-        rewind(_flvFile);
+        FLVPARSER_STATS(ScopedTimer timer(_counters._totalNs));
+        // pipes can only be parsed once, from where they currently are
+        if (_reader->Tell() != 0 && !_reader->Rewind())
+        {
+            std::cerr << "[failed]: the byte source can not be rewound" << std::endl;
+            return false;
+        }
         if (!ParseFLVHeader())
         {
             std::cout << "[failed]: parse flv header failed" << std::endl;
             return false;
         }
-        while (!feof(_flvFile))
+        while (!_reader->Eof())
         {
             if (!ParseFLVTag())
             {
@@ -466,12 +738,280 @@ bool FLVParser::Parse()
     return false;
 }
 
+bool FLVParser::Follow()
+{
+    FLVPARSER_STATS(ScopedTimer timer(_counters._totalNs));
+    if (!_bFollowing)
+    {
+        if (_reader->Tell() != 0 && !_reader->Rewind())
+        {
+            std::cerr << "[failed]: the byte source can not be rewound" << std::endl;
+            return false;
+        }
+        _bFollowing = true;
+        if (!ParseFLVHeader())
+        {
+            if (!_reader->Eof())
+            {
+                _bFollowing = false;
+                std::cout << "[failed]: parse flv header failed" << std::endl;
+                return false;
+            }
+            // the header is not fully written yet
+            _bFollowing = false;
+            _reader->Rewind();
+            return true;
+        }
+        _lastTagEnd = _reader->Tell();
+        _followChunked = 0;
+    }
+    else if (_reader->Tell() != _lastTagEnd && !_reader->Seek(_lastTagEnd))
+    {
+        std::cerr << "[failed]: could not resume at offset " << _lastTagEnd << std::endl;
+        return false;
+    }
+    while (true)
+    {
+        bool bOk = ParseFLVTag();
+        if (_reader->Eof())
+        {
+            // out of data, possibly inside a tag: resume from the last whole one
+            _reader->Seek(_lastTagEnd);
+            return true;
+        }
+        if (!bOk)
+        {
+            std::cout << "[failed]: parse flv tag failed" << std::endl;
+            return false;
+        }
+        _lastTagEnd = _reader->Tell();
+        _followChunked = 0;
+    }
+}
+
+bool FLVParser::ParsePipelined(size_t queueDepth)
+{
+    FLVPARSER_STATS(ScopedTimer timer(_counters._totalNs));
+    if (_reader->Tell() != 0 && !_reader->Rewind())
+    {
+        std::cerr << "[failed]: the byte source can not be rewound" << std::endl;
+        return false;
+    }
+    if (!ParseFLVHeader())
+    {
+        std::cout << "[failed]: parse flv header failed" << std::endl;
+        return false;
+    }
+    _pipeline.reset(new TagPipeline(queueDepth < 2 ? 2 : queueDepth));
+    TagPipeline& pipeline = *_pipeline;
+    _bPipelining = true;
+    std::thread reader(&FLVParser::ReadAhead, this, std::ref(pipeline));
+    try
+    {
+        while (true)
+        {
+            TagRecord* record = nullptr;
+            if (!pipeline._parsed.TryPop(record))
+            {
+                pipeline._callbackWaits.fetch_add(1, std::memory_order_relaxed);
+                pipeline._parsedWaiter.Wait([&]() { return pipeline._parsed.TryPop(record); });
+            }
+            // a record without a tag marks the end of the file or a failure
+            bool bEnd = record->_header._tagType == 0;
+            if (!bEnd)
+                DispatchTag(*record);
+            pipeline._free.TryPush(record);
+            pipeline._freeWaiter.Notify();
+            if (bEnd)
+                break;
+        }
+    }
+    catch (...)
+    {
+        pipeline._bStop = true;
+        pipeline._freeWaiter.Notify();
+        reader.join();
+        _bPipelining = false;
+        throw;
+    }
+    reader.join();
+    _bPipelining = false;
+    if (pipeline._bFailed)
+    {
+        std::cout << "[failed]: parse flv tag failed" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+void FLVParser::ReadAhead(TagPipeline& pipeline)
+{
+    while (true)
+    {
+        TagRecord* record = nullptr;
+        if (!pipeline._free.TryPop(record))
+        {
+            pipeline._readerWaits.fetch_add(1, std::memory_order_relaxed);
+            pipeline._freeWaiter.Wait([&]()
+            {
+                return pipeline._bStop || pipeline._free.TryPop(record);
+            });
+            if (!record)
+                return;
+        }
+        if (_reader->Eof())
+        {
+            record->_header._tagType = 0;
+        }
+        else
+        {
+            // skipped tags are never queued, the record is read again
+            bool bOk;
+            do
+                bOk = ReadTag(*record);
+            while (bOk && record->_bSkipped && !_reader->Eof());
+            if (!bOk)
+            {
+                record->_header._tagType = 0;
+                pipeline._bFailed = true;
+            }
+            else if (record->_bSkipped)
+            {
+                record->_header._tagType = 0;
+            }
+        }
+        bool bEnd = record->_header._tagType == 0;
+        pipeline._parsed.TryPush(record);
+        pipeline._parsedWaiter.Notify();
+
+        size_t queued = pipeline._parsed.Size();
+        if (queued > pipeline._maxQueued.load(std::memory_order_relaxed))
+            pipeline._maxQueued.store(queued, std::memory_order_relaxed);
+        if (bEnd || pipeline._bStop)
+            return;
+    }
+}
+
+bool FLVParser::Next(TagView& view)
+{
+    if (_bPullEnd)
+        return false;
+    if (!_bPulling)
+    {
+        _bFailed = false;
+        if (_reader->Tell() != 0 && !_reader->Rewind())
+        {
+            std::cerr << "[failed]: the byte source can not be rewound" << std::endl;
+            _bFailed = _bPullEnd = true;
+            return false;
+        }
+        if (!ParseFLVHeader())
+        {
+            std::cout << "[failed]: parse flv header failed" << std::endl;
+            _bFailed = _bPullEnd = true;
+            return false;
+        }
+        _bPulling = true;
+    }
+    do
+    {
+        if (_reader->Eof())
+        {
+            _bPullEnd = true;
+            return false;
+        }
+        if (!ReadTag(_record))
+        {
+            std::cout << "[failed]: parse flv tag failed" << std::endl;
+            _bFailed = _bPullEnd = true;
+            return false;
+        }
+        if (_record._header._tagType == 0)
+        {
+            _bPullEnd = true;
+            return false;
+        }
+    }
+    while (_record._bChunked || _record._bSkipped);
+    FillView(_record, view);
+    return true;
+}
+
+void FLVParser::FillView(const TagRecord& record, TagView& view)
+{
+    uint8_t type = record._header._tagType;
+    view._header = &record._header;
+    view._audioHeader = type == 8 ? &record._audioHeader : nullptr;
+    view._videoHeader = type == 9 ? &record._videoHeader : nullptr;
+    view._AVCPacketHeader = type == 9 && (record._videoHeader._codecID == AVC ||
+                                          IsExVideoHeader(record._videoHeader)) ?
+                            &record._AVCPacketHeader : nullptr;
+    view._videoFourCC = type == 9 ? record._fourCC : 0;
+    view._AACPacketType = type == 8 ? record._AACPacketType : 0;
+    view._vp6Byte = type == 9 ? record._vp6Byte : 0;
+    view._data = record._payload;
+    view._dataSize = record._dataSize;
+    view._previousTagSize = record._previousTagSize;
+}
+
+void FLVParser::SetMemoryBudget(const MemoryBudget& budget, ParsingTagChunk onChunk)
+{
+    _budget = budget;
+    _pC = onChunk;
+}
+
+void FLVParser::SetMemoryResource(MemoryResource* resource)
+{
+    _resource = resource ? resource : HeapResource();
+}
+
+void FLVParser::SetKeyframeOnly(bool bEnabled, const KeyframeOptions& options)
+{
+    _bKeyframesOnly = bEnabled;
+    _keyframes = options;
+}
+
+void FLVParser::SetTagFilter(bool bEnabled, const TagFilter& filter)
+{
+    _bFiltering = bEnabled;
+    _filter = filter;
+}
+
+TagRange FLVParser::Tags()
+{
+    _bPulling = false;
+    _bPullEnd = false;
+    return TagRange(this);
+}
+
+PipelineStats FLVParser::Pipeline() const
+{
+    PipelineStats stats;
+    if (_pipeline)
+    {
+        stats._capacity = _pipeline->_records.size();
+        stats._queued = _pipeline->_parsed.Size();
+        stats._maxQueued = _pipeline->_maxQueued.load(std::memory_order_relaxed);
+        stats._readerWaits = _pipeline->_readerWaits.load(std::memory_order_relaxed);
+        stats._callbackWaits = _pipeline->_callbackWaits.load(std::memory_order_relaxed);
+    }
+    return stats;
+}
+
+void FLVParser::ReadFailed(const char* message)
+{
+    // running out of data is expected while following a growing file
+    if (_bFollowing && _reader->Eof())
+        return;
+    std::cerr << "[failed]: " << message << std::endl;
+}
+
 bool FLVParser::ParseFLVHeader()
 {
     FLVHeader header;
-    if (fread((void*)&header, sizeof(FLVHeader), 1, _flvFile) <= 0)
+    if (_reader->Read((void*)&header, sizeof(FLVHeader)) != sizeof(FLVHeader))
     {
-        std::cerr << "[failed]: read the flv header failed" << std::endl;
+        ReadFailed("read the flv header failed");
         return false;
     }
     // check length
@@ -495,12 +1035,20 @@ bool FLVParser::ParseFLVHeader()
     // get video/audio flag
     _bHasVideo = !!header._typeFlagsVideo;
     _bHasAudio = !!header._typeFlagsAudio;
+    // the keyframe selection starts over with every parse
+    _bIndexLoaded = false;
+    _indexTimes.clear();
+    _indexPositions.clear();
+    _keyframesPassed = 0;
+    _lastKeyframe = 0;
+    _bKeyframeDelivered = false;
+    _bKeyframeJumped = false;
 
     // skip first PreviousTagSize0
     uint32_t previousTagSize0 = 0;
-    if (fread((void*)&previousTagSize0, sizeof(uint32_t), 1, _flvFile) <= 0)
+    if (_reader->Read((void*)&previousTagSize0, sizeof(uint32_t)) != sizeof(uint32_t))
     {
-        std::cerr << "[failed]: the previousTagSize0 reads failed" << std::endl;
+        ReadFailed("the previousTagSize0 reads failed");
         return false;
     }
     if (previousTagSize0 != 0)
@@ -508,32 +1056,96 @@ bool FLVParser::ParseFLVHeader()
         std::cerr << "[failed]: the previousTagSize0 != 0" << std::endl;
         return false;
     }
-    _pH(&header, previousTagSize0);
+    FLVPARSER_STATS(_counters._bytesRead += sizeof(header) + sizeof(previousTagSize0));
+    {
+        FLVPARSER_STATS(ScopedTimer timer(_counters._callbackNs));
+        _pH(&header, previousTagSize0);
+    }
     return true;
 }
 
 bool FLVParser::ParseFLVTag()
 {
-    FLVTag::FLVTagHeader header;
-    int size = fread((void*)&header, sizeof(FLVTag::FLVTagHeader), 1, _flvFile);
-    if (size < 0)
+    if (!ReadTag(_record))
+        return false;
+    DispatchTag(_record);
+    return true;
+}
+
+bool FLVParser::ReadTag(TagRecord& record)
+{
+    FLVTag::FLVTagHeader& header = record._header;
+    size_t size = _reader->Read((void*)&header, sizeof(FLVTag::FLVTagHeader));
+    if (size < sizeof(FLVTag::FLVTagHeader))
     {
-        std::cerr << "[failed]: reading the flvtagheader failed" << std::endl;
+        // nothing to dispatch
+        header._tagType = 0;
+        return true;
+    }
+    FLVPARSER_STATS(
+        uint32_t tagSize = TagDataSize(header);
+        _counters._bytesRead += sizeof(header) + tagSize + sizeof(uint32_t);
+        if (tagSize > _counters._maxTagSize)
+            _counters._maxTagSize = tagSize;
+    )
+    int dataSize = 0;
+#if PARSER_ENDIAN == PARSER_LITTLEENDIAN
+    dataSize |= (header._dataSize[2]);
+    dataSize |= (header._dataSize[1] << 8);
+    dataSize |= (header._dataSize[0] << 16);
+#else
+    dataSize |= (header._dataSize[0]);
+    dataSize |= (header._dataSize[1] << 8);
+    dataSize |= (header._dataSize[2] << 16);
+#endif
+    record._dataSize = dataSize;
+    record._bChunked = false;
+    record._bSkipped = false;
+    // a size running past the end of the input is rejected before anything
+    // is allocated for it; a growing file may still deliver the rest
+    uint64_t inputSize = _reader->Size();
+    if (inputSize && !_bFollowing &&
+        _reader->Tell() + dataSize + sizeof(uint32_t) > inputSize)
+    {
+        std::cerr << "[failed]: tag data size " << dataSize << " runs past the end of the input" << std::endl;
         return false;
     }
-    else if (size == 0)
-        return true;
+    if (_bKeyframesOnly && header._tagType != 9)
+    {
+        // onMetaData is only read for its keyframes index
+        if (header._tagType == 18 && _keyframes._bUseIndex && !_bIndexLoaded)
+        {
+            FLVPARSER_STATS(_counters._scriptTags++);
+            if (!ParseScriptTag(record))
+                return false;
+            LoadKeyframeIndex(record);
+            record._bSkipped = true;
+            return true;
+        }
+        return SkipTag(record);
+    }
+    if (_bFiltering && !MatchTagHeader(header, dataSize))
+        return SkipTag(record);
     if (header._tagType == 8)
     {
-        return ParseAudioTag(&header);
+        FLVPARSER_STATS(_counters._audioTags++);
+        return ParseAudioTag(record);
     }
     else if (header._tagType == 9)
     {
-        return ParseVideoTag(&header);
+        FLVPARSER_STATS(_counters._videoTags++);
+        uint64_t tagStart = _reader->Tell() - sizeof(header);
+        if (!ParseVideoTag(record))
+            return false;
+        if (_bKeyframesOnly && !record._bSkipped && !_indexPositions.empty() && !_bFollowing &&
+            !IsVideoSequenceHeader(record._videoHeader, record._AVCPacketHeader))
+            return SeekNextKeyframe(tagStart, TagTimestamp(header));
+        return true;
     }
     else if (header._tagType == 18)
     {
-        return ParseScriptTag(&header);
+        FLVPARSER_STATS(_counters._scriptTags++);
+        return ParseScriptTag(record);
     }
     else
     {
@@ -543,53 +1155,122 @@ bool FLVParser::ParseFLVTag()
     return false;
 }
 
-bool FLVParser::ParseAudioTag(const FLVTag::FLVTagHeader* header)
+bool FLVParser::ParseAudioTag(TagRecord& record)
 {
-    int dataSize = 0;
-#if PARSER_ENDIAN == PARSER_LITTLEENDIAN
-    dataSize |= (header->_dataSize[2]);
-    dataSize |= (header->_dataSize[1] << 8);
-    dataSize |= (header->_dataSize[0] << 16);
-#else
-    dataSize |= (header->_dataSize[0]);
-    dataSize |= (header->_dataSize[1] << 8);
-    dataSize |= (header->_dataSize[2] << 16);
-#endif
-
-    AudioTag::AudioTagHeader audioHeader;
-    if (fread((void*)&audioHeader, sizeof(audioHeader), 1, _flvFile) <= 0)
+    AudioTag::AudioTagHeader& audioHeader = record._audioHeader;
+    if (_reader->Read((void*)&audioHeader, sizeof(audioHeader)) != sizeof(audioHeader))
     {
-        std::cerr << "[failed]: read audio header failed" << std::endl;
+        ReadFailed("read audio header failed");
         return false;
     }
-    dataSize -= sizeof(audioHeader);
-    uint8_t AACPacketType = 0;
+    record._dataSize -= sizeof(audioHeader);
+    record._AACPacketType = 0;
     if (audioHeader._soundFormat == AAC)
     {
-        if (fread((void*)&AACPacketType, sizeof(AACPacketType), 1, _flvFile) <= 0)
+        if (_reader->Read((void*)&record._AACPacketType, sizeof(uint8_t)) != sizeof(uint8_t))
         {
-            std::cerr << "[failed]: read AACPacketType failed" << std::endl;
+            ReadFailed("read AACPacketType failed");
             return false;
         }
-        dataSize -= sizeof(AACPacketType);
+        record._dataSize -= sizeof(uint8_t);
+    }
+    if (_bFiltering && !MatchMediaHeader(record))
+        return SkipTag(record);
+    if (!ReadPayload(record))
+    {
+        ReadFailed("read flv audio data failed");
+        return false;
     }
-    std::shared_ptr<uint8_t> data(new uint8_t[dataSize], std::default_delete<uint8_t[]>());
-    if (dataSize > 0)
+    return ReadPreviousTagSize(record);
+}
+
+bool FLVParser::ParseVideoTag(TagRecord& record)
+{
+    VideoTag::VideoTagHeader& videoHeader = record._videoHeader;
+    if (_reader->Read((void*)&videoHeader, sizeof(videoHeader)) != sizeof(videoHeader))
     {
-        if (fread((void*)data.get(), dataSize, 1, _flvFile) <= 0)
+        ReadFailed("read video header failed");
+        return false;
+    }
+    record._dataSize -= sizeof(videoHeader);
+    record._vp6Byte = 0;
+    record._fourCC = 0;
+    if (IsExVideoHeader(videoHeader))
+    {
+        // the packet type takes the place of the CodecID, the FourCC follows
+        AVCPacket::AVCPacketHeader& AVCPacketHeader = record._AVCPacketHeader;
+        uint8_t packetType = videoHeader._codecID;
+        memset(&AVCPacketHeader, 0, sizeof(AVCPacketHeader));
+        AVCPacketHeader._AVCPacketType = packetType;
+        if (packetType <= VideoPacketMPEG2TSSequenceStart)
         {
-            std::cerr << "[failed]: read flv audio data failed" << std::endl;
+            uint8_t fourCC[4];
+            if (_reader->Read(fourCC, sizeof(fourCC)) != sizeof(fourCC))
+            {
+                ReadFailed("read video FourCC failed");
+                return false;
+            }
+            record._dataSize -= sizeof(fourCC);
+            record._fourCC = ((uint32_t)fourCC[0] << 24) | (fourCC[1] << 16) | (fourCC[2] << 8) | fourCC[3];
+            if (record._fourCC == FourCCHEVC && packetType == VideoPacketCodedFrames)
+            {
+                if (_reader->Read(AVCPacketHeader._compositionTime, sizeof(AVCPacketHeader._compositionTime)) !=
+                    sizeof(AVCPacketHeader._compositionTime))
+                {
+                    ReadFailed("read HEVC composition time failed");
+                    return false;
+                }
+                record._dataSize -= sizeof(AVCPacketHeader._compositionTime);
+            }
+        }
+    }
+    else if (videoHeader._codecID == AVC)
+    {
+        AVCPacket::AVCPacketHeader& AVCPacketHeader = record._AVCPacketHeader;
+        if (_reader->Read((void*)&AVCPacketHeader, sizeof(AVCPacketHeader)) != sizeof(AVCPacketHeader))
+        {
+            ReadFailed("read AVCPacketHeader failed");
             return false;
         }
+        record._dataSize -= sizeof(AVCPacketHeader);
     }
-    AudioTag audioTag;
-    audioTag._header = audioHeader;
-    audioTag._data = data.get();
-    FLVTag tag{ *header, &audioTag };
+    else if (videoHeader._codecID == VP6 || videoHeader._codecID == VP6WithAlpha)
+    {
+        if (_reader->Read((void*)&record._vp6Byte, sizeof(uint8_t)) != sizeof(uint8_t))
+        {
+            ReadFailed("read VP6 byte failed");
+            return false;
+        }
+        record._dataSize -= sizeof(uint8_t);
+    }
+    if (_bFiltering && !MatchMediaHeader(record))
+        return SkipTag(record);
+    if (_bKeyframesOnly && !SelectKeyframe(record))
+        return SkipTag(record);
+    if (!ReadPayload(record))
+    {
+        ReadFailed("read flv video data failed");
+        return false;
+    }
+    return ReadPreviousTagSize(record);
+}
+
+bool FLVParser::ParseScriptTag(TagRecord& record)
+{
+    if (!ReadPayload(record))
+    {
+        ReadFailed("read the flv meta data failed");
+        return false;
+    }
+    return ReadPreviousTagSize(record);
+}
+
+bool FLVParser::ReadPreviousTagSize(TagRecord& record)
+{
     uint32_t iPreviousTagSize = 0;
-    if (fread((void*)&iPreviousTagSize, sizeof(uint32_t), 1, _flvFile) <= 0)
+    if (_reader->Read((void*)&iPreviousTagSize, sizeof(uint32_t)) != sizeof(uint32_t))
     {
-        std::cerr << "[failed]: read the iPreviousTagSize failed" << std::endl;
+        ReadFailed("read the iPreviousTagSize failed");
         return false;
     }
 #if PARSER_ENDIAN == PARSER_LITTLEENDIAN
@@ -600,116 +1281,291 @@ bool FLVParser::ParseAudioTag(const FLVTag::FLVTagHeader* header)
     iPreviousTagSizeL |= ((t & 0xFF) << 24);
     iPreviousTagSize = iPreviousTagSizeL;
 #endif
-    _pA(&tag, dataSize, iPreviousTagSize, AACPacketType);
+    record._previousTagSize = iPreviousTagSize;
     return true;
 }
 
-bool FLVParser::ParseVideoTag(const FLVTag::FLVTagHeader* header)
+void FLVParser::DispatchTag(TagRecord& record)
 {
-    int dataSize = 0;
-#if PARSER_ENDIAN == PARSER_LITTLEENDIAN
-    dataSize |= (header->_dataSize[2]);
-    dataSize |= (header->_dataSize[1] << 8);
-    dataSize |= (header->_dataSize[0] << 16);
-#else
-    dataSize |= (header->_dataSize[0]);
-    dataSize |= (header->_dataSize[1] << 8);
-    dataSize |= (header->_dataSize[2] << 16);
-#endif
+    if (record._bChunked || record._bSkipped)
+        return;
+    FLVPARSER_STATS(ScopedTimer timer(_counters._callbackNs));
+    if (record._header._tagType == 8)
+    {
+        AudioTag audioTag;
+        audioTag._header = record._audioHeader;
+        audioTag._data = record._payload;
+        FLVTag tag{ record._header, &audioTag };
+        _pA(&tag, record._dataSize, record._previousTagSize, record._AACPacketType);
+    }
+    else if (record._header._tagType == 9)
+    {
+        VideoTag videoTag;
+        videoTag._header = record._videoHeader;
+        videoTag._data = record._payload;
+        videoTag._fourCC = record._fourCC;
+        FLVTag tag{ record._header, &videoTag };
+        _pV(&tag, record._dataSize, record._previousTagSize, &record._AVCPacketHeader, record._vp6Byte);
+    }
+    else if (record._header._tagType == 18)
+    {
+        FLVTag tag{ record._header, record._payload };
+        _pS(&tag, record._dataSize, record._previousTagSize);
+    }
+}
 
-    VideoTag::VideoTagHeader videoHeader;
-    if (fread((void*)&videoHeader, sizeof(videoHeader), 1, _flvFile) <= 0)
+void FLVParser::Reserve(TagRecord& record, size_t size)
+{
+    if (size > record._buffer.Size())
     {
-        std::cerr << "[failed]: read video header failed" << std::endl;
-        return false;
+        record._buffer.Allocate(_resource, size);
+        FLVPARSER_STATS(_counters._allocations++; _counters._bytesAllocated += size);
     }
-    dataSize -= sizeof(videoHeader);
-    AVCPacket::AVCPacketHeader AVCPacketHeader;
-    uint8_t vp6Byte = 0;
-    if (videoHeader._codecID == AVC)
+}
+
+bool FLVParser::ReadPayload(TagRecord& record)
+{
+    int dataSize = record._dataSize;
+    if (dataSize < 0)
+        return false;
+    if (_budget._maxTagBytes && (uint32_t)dataSize > _budget._maxTagBytes && _pC)
+        return ReadChunks(record);
+    // memory backed sources lend the payload without a copy
+    record._payload = (void*)_reader->Borrow(dataSize);
+    if (record._payload)
+        return true;
+    Reserve(record, dataSize);
+    record._payload = record._buffer.Get();
+    if (dataSize > 0 && _reader->Read(record._payload, dataSize) != (size_t)dataSize)
+        return false;
+    return true;
+}
+
+bool FLVParser::ReadChunks(TagRecord& record)
+{
+    if (_bPipelining)
     {
-        if (fread((void*)&AVCPacketHeader, sizeof(AVCPacketHeader), 1, _flvFile) <= 0)
+        // the tags queued before this one go to their callbacks first
+        TagPipeline& pipeline = *_pipeline;
+        pipeline._freeWaiter.Wait([&]()
         {
-            std::cerr << "[failed]: read AVCPacketHeader failed" << std::endl;
+            return pipeline._bStop || pipeline._free.Size() + 1 == pipeline._records.size();
+        });
+        if (pipeline._bStop)
             return false;
-        }
-        dataSize -= sizeof(AVCPacketHeader);
     }
-    else if (videoHeader._codecID == VP6 || videoHeader._codecID == VP6WithAlpha)
+    record._bChunked = true;
+    uint32_t chunkBytes = _budget._chunkBytes ? _budget._chunkBytes : (64 << 10);
+    uint32_t payloadSize = record._dataSize;
+    TagView view;
+    FillView(record, view);
+    view._previousTagSize = 0;      // not read yet
+    uint32_t offset = 0;
+    if (_bFollowing && _followChunked)
     {
-        if (fread((void*)&vp6Byte, sizeof(uint8_t), 1, _flvFile) <= 0)
-        {
-            std::cerr << "[failed]: read VP6 byte failed" << std::endl;
+        // Follow() ran out of data inside this tag last time, the chunks it
+        // delivered then are stepped over instead of delivered again
+        if (!_reader->Skip(_followChunked))
             return false;
-        }
-        dataSize -= sizeof(uint8_t);
+        offset = _followChunked;
     }
-    std::shared_ptr<uint8_t> data(new uint8_t[dataSize], std::default_delete<uint8_t[]>());
-    if (dataSize > 0)
+    while (offset < payloadSize)
     {
-        if (fread((void*)data.get(), dataSize, 1, _flvFile) <= 0)
+        uint32_t size = payloadSize - offset < chunkBytes ? payloadSize - offset : chunkBytes;
+        const uint8_t* chunk = _reader->Borrow(size);
+        if (!chunk)
         {
-            std::cerr << "[failed]: read flv video data failed" << std::endl;
-            return false;
+            Reserve(record, size);
+            if (_reader->Read(record._buffer.Get(), size) != size)
+                return false;
+            chunk = record._buffer.Get();
         }
+        view._data = chunk;
+        view._dataSize = size;
+        {
+            FLVPARSER_STATS(ScopedTimer timer(_counters._callbackNs));
+            _pC(view, offset, payloadSize);
+        }
+        offset += size;
+        if (_bFollowing)
+            _followChunked = offset;
     }
-    VideoTag videoTag;
-    videoTag._header = videoHeader;
-    videoTag._data = data.get();
-    FLVTag tag{ *header, &videoTag };
-    uint32_t iPreviousTagSize = 0;
-    if (fread((void*)&iPreviousTagSize, sizeof(uint32_t), 1, _flvFile) <= 0)
+    return true;
+}
+
+bool FLVParser::SkipTag(TagRecord& record)
+{
+    record._bSkipped = true;
+    record._payload = nullptr;
+    // seekable sources step over the payload without reading it
+    if (record._dataSize < 0 || !_reader->Skip((uint64_t)record._dataSize + sizeof(uint32_t)))
     {
-        std::cerr << "[failed]: read the iPreviousTagSize failed" << std::endl;
+        ReadFailed("skip the flv tag failed");
         return false;
     }
-#if PARSER_ENDIAN == PARSER_LITTLEENDIAN
-    uint32_t t = iPreviousTagSize;
-    uint32_t iPreviousTagSizeL = t >> 24;
-    iPreviousTagSizeL |= ((t & 0xFF0000) >> 8);
-    iPreviousTagSizeL |= ((t & 0xFF00) << 8);
-    iPreviousTagSizeL |= ((t & 0xFF) << 24);
-    iPreviousTagSize = iPreviousTagSizeL;
-#endif
-    _pV(&tag, dataSize, iPreviousTagSize, &AVCPacketHeader, vp6Byte);
+    FLVPARSER_STATS(_counters._skippedTags++);
     return true;
 }
 
-bool FLVParser::ParseScriptTag(const FLVTag::FLVTagHeader* header)
+bool FLVParser::MatchTagHeader(const FLVTag::FLVTagHeader& header, uint32_t dataSize) const
 {
-    int dataSize = 0;
-#if PARSER_ENDIAN == PARSER_LITTLEENDIAN
-    dataSize |= (header->_dataSize[2]);
-    dataSize |= (header->_dataSize[1] << 8);
-    dataSize |= (header->_dataSize[0] << 16);
-#else
-    dataSize |= (header->_dataSize[0]);
-    dataSize |= (header->_dataSize[1] << 8);
-    dataSize |= (header->_dataSize[2] << 16);
-#endif
-    // skip data
-    std::shared_ptr<uint8_t> data(new uint8_t[dataSize], std::default_delete<uint8_t[]>());
-    if (fread((void*)data.get(), dataSize, 1, _flvFile) <= 0)
+    const TagFilter& filter = _filter;
+    if ((header._tagType == 8 && !filter._bAudio) ||
+        (header._tagType == 9 && !filter._bVideo) ||
+        (header._tagType == 18 && !filter._bScript))
+        return false;
+    if (dataSize < filter._minSize || dataSize > filter._maxSize)
+        return false;
+    uint32_t timestamp = TagTimestamp(header);
+    return timestamp >= filter._startMs && timestamp < filter._endMs;
+}
+
+// the masks hold 32 values, larger ones only match an empty mask
+static inline bool InMask(uint32_t mask, uint32_t value)
+{
+    return !mask || (value < 32 && (mask & (1u << value)));
+}
+
+bool FLVParser::MatchMediaHeader(const TagRecord& record) const
+{
+    const TagFilter& filter = _filter;
+    if (record._header._tagType == 8)
+    {
+        const AudioTag::AudioTagHeader& audio = record._audioHeader;
+        if (!InMask(filter._soundFormats, audio._soundFormat))
+            return false;
+        return audio._soundFormat != AAC || InMask(filter._AACPacketTypes, record._AACPacketType);
+    }
+    const VideoTag::VideoTagHeader& video = record._videoHeader;
+    bool bEnhanced = IsExVideoHeader(video);
+    // with a codec wanted, legacy and enhanced tags each match their own
+    // field; a tag whose field is unset matches no codec
+    if (filter._videoCodecs || filter._videoFourCC)
+    {
+        if (bEnhanced ? record._fourCC != filter._videoFourCC
+                      : !filter._videoCodecs || !InMask(filter._videoCodecs, video._codecID))
+            return false;
+    }
+    uint8_t frameType = VideoFrameType(video);
+    if (filter._bKeyframesOnly && frameType != KeyFrame && frameType != GeneratedKeyFrame)
+        return false;
+    if (bEnhanced)
+        return InMask(filter._exPacketTypes, video._codecID);
+    return video._codecID != AVC || InMask(filter._AVCPacketTypes, record._AVCPacketHeader._AVCPacketType);
+}
+
+bool FLVParser::SelectKeyframe(const TagRecord& record)
+{
+    const VideoTag::VideoTagHeader& video = record._videoHeader;
+    // every sequence header goes out, the keyframes after it depend on it
+    if (IsVideoSequenceHeader(video, record._AVCPacketHeader))
+        return true;
+    uint8_t frameType = VideoFrameType(video);
+    if (frameType != KeyFrame && frameType != GeneratedKeyFrame)
+        return false;
+    if (!IsVideoCodedFrame(video, record._AVCPacketHeader))
+        return false;
+    uint32_t timestamp = TagTimestamp(record._header);
+    uint32_t everyNth = _keyframes._everyNth ? _keyframes._everyNth : 1;
+    // a timestamp going back is a discontinuity, the spacing starts over
+    bool bWanted = _bKeyframeJumped || !_bKeyframeDelivered || timestamp < _lastKeyframe ||
+        (_keyframesPassed + 1 >= everyNth &&
+         timestamp >= (uint64_t)_lastKeyframe + _keyframes._intervalMs);
+    _bKeyframeJumped = false;
+    if (!bWanted)
     {
-        std::cerr << "[failed]: read the flv meta data failed" << std::endl;
+        _keyframesPassed++;
         return false;
     }
-    FLVTag tag{ *header, data.get() };
-    uint32_t iPreviousTagSize = 0;
-    if (fread((void*)&iPreviousTagSize, sizeof(uint32_t), 1, _flvFile) <= 0)
+    _keyframesPassed = 0;
+    _lastKeyframe = timestamp;
+    _bKeyframeDelivered = true;
+    return true;
+}
+
+void FLVParser::LoadKeyframeIndex(TagRecord& record)
+{
+    _bIndexLoaded = true;
+    std::vector<double> times;
+    std::vector<double> positions;
+    if (record._bChunked || !FindKeyframeIndex(record._payload, record._dataSize, times, positions))
+        return;
+    // entries at or before onMetaData point at nothing that can be jumped to
+    uint64_t end = _reader->Tell();
+    for (size_t idx = 0; idx < positions.size(); idx++)
     {
-        std::cerr << "[failed]: read the iPreviousTagSize failed" << std::endl;
+        double position = positions[idx];
+        double time = times[idx];
+        if (!(position >= 0 && position < 9.0e15 && time >= 0 && time < 4294967.0))
+        {
+            std::cerr << "[warning]: the keyframes index holds invalid entries, ignored" << std::endl;
+            _indexTimes.clear();
+            _indexPositions.clear();
+            return;
+        }
+        uint64_t offset = (uint64_t)position;
+        if (offset < end)
+            continue;
+        if (!_indexPositions.empty() && offset <= _indexPositions.back())
+        {
+            std::cerr << "[warning]: the keyframes index is not in file order, ignored" << std::endl;
+            _indexTimes.clear();
+            _indexPositions.clear();
+            return;
+        }
+        _indexTimes.push_back((uint32_t)(time * 1000 + 0.5));
+        _indexPositions.push_back(offset);
+    }
+}
+
+bool FLVParser::SeekNextKeyframe(uint64_t tagStart, uint32_t timestamp)
+{
+    // the Nth indexed keyframe after this one, moved on until it is far
+    // enough away in time
+    size_t target = std::upper_bound(_indexPositions.begin(), _indexPositions.end(), tagStart) -
+                    _indexPositions.begin();
+    target += (_keyframes._everyNth ? _keyframes._everyNth : 1) - 1;
+    uint64_t wanted = (uint64_t)timestamp + _keyframes._intervalMs;
+    while (target < _indexTimes.size() && _indexTimes[target] < wanted)
+        target++;
+    // past the end of the index the remaining tags are walked
+    if (target >= _indexPositions.size())
+        return true;
+    uint64_t position = _indexPositions[target];
+    uint64_t current = _reader->Tell();
+    if (position <= current)
+        return true;
+    if (!_reader->Seek(position))
+    {
+        // the source can not seek, walking the tags still works
+        _indexTimes.clear();
+        _indexPositions.clear();
+        return true;
+    }
+    // the index is a hint from the muxer, it is trusted only when a video
+    // keyframe starts where it points
+    uint8_t bytes[sizeof(FLVTag::FLVTagHeader) + 1];
+    uint8_t frameType = 0;
+    bool bValid = _reader->Read(bytes, sizeof(bytes)) == sizeof(bytes) && bytes[0] == 9;
+    if (bValid)
+    {
+        frameType = (bytes[sizeof(FLVTag::FLVTagHeader)] >> 4) & 0x07;
+        bValid = frameType == KeyFrame || frameType == GeneratedKeyFrame;
+    }
+    if (bValid && _reader->Seek(position))
+    {
+        _bKeyframeJumped = true;
+        FLVPARSER_STATS(_counters._indexSeeks++);
+        return true;
+    }
+    std::cerr << "[warning]: the keyframes index does not match the file, walking the tags" << std::endl;
+    _indexTimes.clear();
+    _indexPositions.clear();
+    if (!_reader->Seek(current))
+    {
+        std::cerr << "[failed]: could not return to offset " << current << std::endl;
         return false;
     }
-#if PARSER_ENDIAN == PARSER_LITTLEENDIAN
-    uint32_t t = iPreviousTagSize;
-    uint32_t iPreviousTagSizeL = t >> 24;
-    iPreviousTagSizeL |= ((t & 0xFF0000) >> 8);
-    iPreviousTagSizeL |= ((t & 0xFF00) << 8);
-    iPreviousTagSizeL |= ((t & 0xFF) << 24);
-    iPreviousTagSize = iPreviousTagSizeL;
-#endif
-    _pS(&tag, dataSize, iPreviousTagSize);
     return true;
 }
 
@@ -19,8 +19,14 @@
 #define FLVPARSER_H_
 
 #include "common.h"
+#include "flvmemory.h"
+#include "flvreader.h"
 
 #include <functional>
+#include <iterator>
+#include <memory>
+#include <new>
+#include <vector>
 
 FLVPARSER_NAMESPACE_BEGIN
 
@@ -75,6 +81,13 @@ enum AACPacketType
     AACRaw
 };
 
+enum AVCPacketType
+{
+    AVCSequenceHeader = 0,
+    AVCNALU,
+    AVCEndOfSequence
+};
+
 enum FrameType
 {
     KeyFrame = 1,
@@ -94,6 +107,26 @@ enum CodecID
     AVC
 };
 
+// Enhanced FLV (E-RTMP v1): bit 7 of the first video byte is IsExHeader, the
+// frame type shrinks to the 3 bits below it, the low nibble becomes a
+// VideoPacketType and a FourCC follows instead of the CodecID
+enum VideoPacketType
+{
+    VideoPacketSequenceStart = 0,
+    VideoPacketCodedFrames,                 //!< HEVC adds an SI24 composition time
+    VideoPacketSequenceEnd,
+    VideoPacketCodedFramesX,                //!< Composition time 0
+    VideoPacketMetadata,
+    VideoPacketMPEG2TSSequenceStart
+};
+
+enum VideoFourCC
+{
+    FourCCVP9   = 0x76703039,               //!< "vp09"
+    FourCCAV1   = 0x61763031,               //!< "av01"
+    FourCCHEVC  = 0x68766331                //!< "hvc1"
+};
+
 #pragma pack(push)
 #pragma pack(1)
 
@@ -142,10 +175,11 @@ struct VideoTag
     struct VideoTagHeader
     {
         uint8_t     _codecID        : 4;    //!< Codec identifier
-        uint8_t     _frameType      : 4;    //!< Type of video frame
+        uint8_t     _frameType      : 4;    //!< Type of video frame, bit 3 is IsExHeader
     }
     _header;
     void*       _data;
+    uint32_t    _fourCC;                    //!< Enhanced tags only, 0 otherwise
 };
 
 struct AACPacket
@@ -166,12 +200,83 @@ struct AVCPacket
 };
 #pragma pack(pop)
 
+// Big endian fields of the tag header
+inline uint32_t TagDataSize(const FLVTag::FLVTagHeader& header)
+{
+    return (header._dataSize[0] << 16) | (header._dataSize[1] << 8) | header._dataSize[2];
+}
+
+// Full 32 bits timestamp in milliseconds, _timestampExtended is the high byte
+inline uint32_t TagTimestamp(const FLVTag::FLVTagHeader& header)
+{
+    return ((uint32_t)header._timestampExtended << 24) | (header._timestamp[0] << 16) |
+           (header._timestamp[1] << 8) | header._timestamp[2];
+}
+
+inline void SetTagDataSize(FLVTag::FLVTagHeader& header, uint32_t dataSize)
+{
+    header._dataSize[0] = (uint8_t)(dataSize >> 16);
+    header._dataSize[1] = (uint8_t)(dataSize >> 8);
+    header._dataSize[2] = (uint8_t)dataSize;
+}
+
+inline void SetTagTimestamp(FLVTag::FLVTagHeader& header, uint32_t timestamp)
+{
+    header._timestamp[0] = (uint8_t)(timestamp >> 16);
+    header._timestamp[1] = (uint8_t)(timestamp >> 8);
+    header._timestamp[2] = (uint8_t)timestamp;
+    header._timestampExtended = (uint8_t)(timestamp >> 24);
+}
+
+inline bool IsExVideoHeader(const VideoTag::VideoTagHeader& header)
+{
+    return (header._frameType & 0x08) != 0;
+}
+
+// FrameType of legacy and enhanced tags alike
+inline uint8_t VideoFrameType(const VideoTag::VideoTagHeader& header)
+{
+    return header._frameType & 0x07;
+}
+
+// The video header at the start of a tag's data, legacy or enhanced
+struct VideoHeaderInfo
+{
+    uint8_t     _frameType          { 0 };      //!< IsExHeader bit removed
+    uint8_t     _codecID            { 0 };      //!< Legacy tags only
+    uint8_t     _packetType         { 0 };      //!< AVCPacketType or VideoPacketType
+    uint32_t    _fourCC             { 0 };      //!< Enhanced tags only
+    int32_t     _compositionTime    { 0 };      //!< AVC and HEVC coded frames
+    uint32_t    _headerSize         { 0 };      //!< Bytes before the codec data
+    bool        _bEnhanced          { false };
+    bool        _bSequenceHeader    { false };  //!< AVC sequence header or SequenceStart
+    bool        _bCodedFrame        { false };  //!< A picture, not a config, end or metadata packet
+
+    bool        IsKeyframe() const
+    {
+        return _bCodedFrame && (_frameType == KeyFrame || _frameType == GeneratedKeyFrame);
+    }
+};
+
+//! False when data is shorter than the header its first byte announces
+bool    ParseVideoHeader(const uint8_t* data, size_t size, VideoHeaderInfo& info);
+
+// Longest video header the parser splits from the payload
+static const size_t kMaxVideoHeaderSize = 8;
+
+//! Rebuilds the header bytes the parser split from a video payload, out
+//! holds kMaxVideoHeaderSize bytes; returns the size written
+size_t  WriteVideoHeader(const VideoTag& video, const AVCPacket::AVCPacketHeader* AVCHeader,
+                         uint8_t vp6Byte, uint8_t* out);
+
 // std::function bind for parsing flv data
 
 using ParsingFLVHeader = std::function<void(FLVHeader*,
                                             uint32_t
                                             )>;
 
+// For enhanced video tags the AVCPacketHeader holds the VideoPacketType
+// and the HEVC composition time, VideoTag::_fourCC tells the codec
 using ParsingVideoTag  = std::function<void(FLVTag*,
                                             int,
                                             uint32_t,
@@ -214,10 +319,10 @@ enum ScriptDataType
 
 struct ScriptData
 {
-    uint8_t             _type;
-    void*               _data;
-    void*               _extra {nullptr};
-    ScriptData*         _value;
+    uint8_t             _type       {0};
+    void*               _data       {nullptr};
+    void*               _extra      {nullptr};
+    ScriptData*         _value      {nullptr};
 };
 
 struct ScriptDataDate
@@ -229,7 +334,8 @@ struct ScriptDataDate
 class ScriptKVDataParser
 {
 public:
-    ScriptKVDataParser(FLVTag* scriptTag, int size);
+    //! Every node of the tree comes from resource, nullptr is the heap
+    ScriptKVDataParser(FLVTag* scriptTag, int size, MemoryResource* resource = nullptr);
     ~ScriptKVDataParser();
     bool Parse();
     void Free();
@@ -238,14 +344,133 @@ private:
 
     void                ParseScriptTagBody(int& offset, ScriptData*& scriptTagBody, bool bKey);
     void                FreeData(ScriptData* data, bool bKey);
+    void                FreeNode(ScriptData* data, bool bKey);
+    char*               CreateString(const uint8_t* data, uint32_t length);
+    void                DestroyString(char* str);
+    ScriptData*         CreateArray(uint32_t count);
+
+    template <typename T>
+    T*                  Create(const T& value)
+    {
+        return new (_resource->Allocate(sizeof(T), alignof(T))) T(value);
+    }
+
+    template <typename T>
+    void                Destroy(T* p)
+    {
+        p->~T();
+        _resource->Deallocate(p, sizeof(T), alignof(T));
+    }
 
     ScriptData*         _scriptTagBody { nullptr };
     FLVTag*             _scriptTag;
     int                 _size;
+    MemoryResource*     _resource;
+    int                 _depth      { 0 };      //!< Containers being parsed
+};
+
+// Per parser counters, all zero unless the library is built with PARSER_STATS
+struct ParserCounters
+{
+    uint64_t        _bytesRead          { 0 };  //!< Bytes consumed from the source
+    uint64_t        _readCalls          { 0 };  //!< Read system calls issued by the source
+    uint64_t        _allocations        { 0 };  //!< Payload buffers allocated
+    uint64_t        _bytesAllocated     { 0 };
+    uint64_t        _audioTags          { 0 };
+    uint64_t        _videoTags          { 0 };
+    uint64_t        _scriptTags         { 0 };
+    uint64_t        _skippedTags        { 0 };  //!< Stepped over without reading the payload
+    uint64_t        _indexSeeks         { 0 };  //!< Jumps through the keyframes index
+    uint64_t        _totalNs            { 0 };  //!< Time inside Parse(), callbacks included
+    uint64_t        _callbackNs         { 0 };  //!< Time inside the user callbacks
+    uint32_t        _maxTagSize         { 0 };  //!< Largest DataSize seen
+};
+
+// Backpressure of ParsePipelined(): a queue that stays full means the
+// callbacks are the bottleneck, one that stays empty means the reading is
+struct PipelineStats
+{
+    size_t          _capacity           { 0 };  //!< Tags that can be parsed ahead
+    size_t          _queued             { 0 };  //!< Parsed tags waiting for the callbacks
+    size_t          _maxQueued          { 0 };
+    uint64_t        _readerWaits        { 0 };  //!< Reader found the queue full
+    uint64_t        _callbackWaits      { 0 };  //!< Callbacks found the queue empty
+};
+
+// View of the current tag of the pull API. The pointers refer to the
+// parser, they stay valid until the parser advances to the next tag.
+struct TagView
+{
+    const FLVTag::FLVTagHeader*         _header             { nullptr };
+    const AudioTag::AudioTagHeader*     _audioHeader        { nullptr };    //!< Audio tags only
+    const VideoTag::VideoTagHeader*     _videoHeader        { nullptr };    //!< Video tags only
+    const AVCPacket::AVCPacketHeader*   _AVCPacketHeader    { nullptr };    //!< AVC and enhanced video tags only
+    uint32_t                            _videoFourCC        { 0 };          //!< Enhanced video tags only
+    uint8_t                             _AACPacketType      { 0 };
+    uint8_t                             _vp6Byte            { 0 };
+    const void*                         _data               { nullptr };    //!< Payload after the media headers
+    int                                 _dataSize           { 0 };
+    uint32_t                            _previousTagSize    { 0 };
+
+    uint8_t             Type() const        { return _header->_tagType; }
+    uint32_t            Timestamp() const   { return TagTimestamp(*_header); }
+};
 
-    
+// Caps the memory one parser holds for a tag: payloads above _maxTagBytes
+// are not buffered whole, they go to the chunk callback in pieces read
+// into one reused buffer of _chunkBytes
+struct MemoryBudget
+{
+    uint32_t        _maxTagBytes        { 0 };          //!< 0 buffers every payload whole
+    uint32_t        _chunkBytes         { 64 << 10 };
+};
+
+// One piece of an oversized payload: view._data and view._dataSize are the
+// piece, offset is where it starts in the payload of payloadSize bytes.
+// The tag callbacks are not called for chunked tags.
+using ParsingTagChunk = std::function<void(const TagView& view, uint32_t offset, uint32_t payloadSize)>;
+
+// Keyframe extraction: only video keyframes and AVC sequence headers are
+// delivered, every other tag is stepped over with a seek. When onMetaData
+// carries a keyframes index the parser jumps straight to the next wanted
+// keyframe instead of walking the tags in between; a sequence header that
+// changes mid-stream inside a jumped range is then not seen.
+struct KeyframeOptions
+{
+    uint32_t        _everyNth           { 1 };      //!< Deliver one keyframe out of every N
+    uint32_t        _intervalMs         { 0 };      //!< And at least this far apart, 0 is no limit
+    bool            _bUseIndex          { true };   //!< Jump with onMetaData keyframes.filepositions
+};
+
+// Declarative filter checked before any payload is read: the tag type, time
+// and size come from the 11 bytes tag header, the codec, frame type and
+// packet type from the media header bytes. Tags that do not match are
+// stepped over like in the keyframe mode and never reach the callbacks;
+// their payload is neither copied nor allocated, and not read from disk
+// either when the file is opened with the pread options SetKeyframeOnly()
+// describes.
+// The masks are 1 << value, 0 lets every value through; once a codec is
+// asked for, legacy tags match _videoCodecs and enhanced ones _videoFourCC.
+struct TagFilter
+{
+    bool            _bAudio             { true };
+    bool            _bVideo             { true };
+    bool            _bScript            { true };
+    uint32_t        _startMs            { 0 };          //!< Timestamps in [_startMs, _endMs)
+    uint32_t        _endMs              { 0xFFFFFFFF };
+    uint32_t        _minSize            { 0 };          //!< DataSize range, media headers included
+    uint32_t        _maxSize            { 0xFFFFFFFF };
+    uint32_t        _soundFormats       { 0 };          //!< 1 << SoundFormat
+    uint32_t        _videoCodecs        { 0 };          //!< 1 << CodecID, legacy tags
+    uint32_t        _videoFourCC        { 0 };          //!< Enhanced tags, matched once any codec is asked for
+    bool            _bKeyframesOnly     { false };      //!< Video tags must be keyframes
+    uint32_t        _AACPacketTypes     { 0 };          //!< 1 << AACPacketType, AAC tags only
+    uint32_t        _AVCPacketTypes     { 0 };          //!< 1 << AVCPacketType, AVC tags only
+    uint32_t        _exPacketTypes      { 0 };          //!< 1 << VideoPacketType, enhanced tags only
 };
 
+class TagRange;
+
 class FLVParser
 {
 public:
@@ -255,29 +480,182 @@ public:
               ParsingAudioTag pA  = &DoNothingOnAudioTag,
               ParsingScriptTag pS = &DoNothingOnScriptTag);
 
+    FLVParser(const char* inputFile,
+              const ReadOptions& readOptions,
+              ParsingFLVHeader pH = &DoNothingOnFLVHeader,
+              ParsingVideoTag pV  = &DoNothingOnVideoTag,
+              ParsingAudioTag pA  = &DoNothingOnAudioTag,
+              ParsingScriptTag pS = &DoNothingOnScriptTag);
+
+    // Parse from any byte source, the source is not owned by the parser
+    FLVParser(ByteSource* source,
+              ParsingFLVHeader pH = &DoNothingOnFLVHeader,
+              ParsingVideoTag pV  = &DoNothingOnVideoTag,
+              ParsingAudioTag pA  = &DoNothingOnAudioTag,
+              ParsingScriptTag pS = &DoNothingOnScriptTag);
+
     ~FLVParser();
 
     FLVParser(const FLVParser&)             = delete;
     FLVParser& operator= (const FLVParser&) = delete;
 
     bool Parse();
+    // Parse a file that is still growing, best with a FollowSource. Stops at
+    // the end of the data without treating a partial tag as an error, the
+    // next call resumes from the last complete tag.
+    bool Follow();
+    // Parse with a reader thread running up to queueDepth tags ahead of the
+    // callbacks, which still run on the calling thread. Payload buffers are
+    // recycled between the two, so the callbacks may keep no pointers.
+    bool ParsePipelined(size_t queueDepth = 64);
+    // Pull API: the first call reads the file header, every call then moves
+    // to the next tag without running the tag callbacks. False at the end
+    // of the data or on an error, Failed() tells them apart.
+    bool                Next(TagView& view);
+    bool                Failed() const      { return _bFailed; }
+    //! Restarts the pull API from the file header
+    TagRange            Tags();
+    //! Also applies to Next(), and to ParsePipelined() where the chunks are
+    //! delivered on the reader thread once the queued tags are dispatched
+    void                SetMemoryBudget(const MemoryBudget& budget, ParsingTagChunk onChunk);
+    //! Payload buffers come from resource, nullptr is the heap. Set it
+    //! before parsing, the resource must outlive the parser;
+    //! ParsePipelined() allocates on the reader thread.
+    void                SetMemoryResource(MemoryResource* resource);
+    MemoryResource*     Resource() const    { return _resource; }
+    //! Applies to every parsing mode, index jumps need a seekable source
+    //! and are not taken by Follow(). Skipped tags are stepped over with
+    //! Seek(), which only saves I/O when the source does not read ahead of
+    //! it: open the file with ReadBackendPread and small blocks (64K). With
+    //! the default ReadOptions a FileReader still reads every byte closer
+    //! than _queueDepth * _blockSize to the last position.
+    void                SetKeyframeOnly(bool bEnabled, const KeyframeOptions& options = KeyframeOptions());
+    //! Set before parsing, combines with the keyframe only mode
+    void                SetTagFilter(bool bEnabled, const TagFilter& filter = TagFilter());
+    ReadBackend         Backend() const;
+    ParserCounters      Counters() const;
+    void                ResetCounters();
+    //! Can be sampled from any thread while ParsePipelined() runs
+    PipelineStats       Pipeline() const;
 
 private:
+    // One tag as read from the source, the callbacks get it in DispatchTag()
+    struct TagRecord
+    {
+        FLVTag::FLVTagHeader        _header;
+        AudioTag::AudioTagHeader    _audioHeader;
+        VideoTag::VideoTagHeader    _videoHeader;
+        AVCPacket::AVCPacketHeader  _AVCPacketHeader;
+        uint8_t                     _AACPacketType      { 0 };
+        uint8_t                     _vp6Byte            { 0 };
+        uint32_t                    _fourCC             { 0 };  //!< Enhanced video tags only
+        int                         _dataSize           { 0 };  //!< Payload bytes after the media headers
+        uint32_t                    _previousTagSize    { 0 };
+        void*                       _payload            { nullptr };
+        ResourceBuffer              _buffer;                    //!< Reused by the following tags
+        bool                        _bChunked           { false };  //!< Already handed to the chunk callback
+        bool                        _bSkipped           { false };  //!< Not wanted, the payload was not read
+    };
+    struct TagPipeline;
+
     inline bool         ParseFLVHeader();
     inline bool         ParseFLVTag();
-    inline bool         ParseAudioTag(const FLVTag::FLVTagHeader* header);
-    inline bool         ParseVideoTag(const FLVTag::FLVTagHeader* header);
-    inline bool         ParseScriptTag(const FLVTag::FLVTagHeader* header);
+    inline bool         ReadTag(TagRecord& record);
+    inline bool         ParseAudioTag(TagRecord& record);
+    inline bool         ParseVideoTag(TagRecord& record);
+    inline bool         ParseScriptTag(TagRecord& record);
+    inline bool         ReadPreviousTagSize(TagRecord& record);
+    inline void         DispatchTag(TagRecord& record);
+    inline void         FillView(const TagRecord& record, TagView& view);
+    bool                ReadChunks(TagRecord& record);
+    inline void         Reserve(TagRecord& record, size_t size);
+    void                ReadAhead(TagPipeline& pipeline);
+    void                ReadFailed(const char* message);
+    inline bool         ReadPayload(TagRecord& record);
+    inline bool         SkipTag(TagRecord& record);
+    bool                MatchTagHeader(const FLVTag::FLVTagHeader& header, uint32_t dataSize) const;
+    bool                MatchMediaHeader(const TagRecord& record) const;
+    bool                SelectKeyframe(const TagRecord& record);
+    void                LoadKeyframeIndex(TagRecord& record);
+    bool                SeekNextKeyframe(uint64_t tagStart, uint32_t timestamp);
 
 private:
     ParsingFLVHeader    _pH;
     ParsingVideoTag     _pV;
     ParsingAudioTag     _pA;
     ParsingScriptTag    _pS;
-
-    FILE*               _flvFile    { nullptr };
+    ParsingTagChunk     _pC;
+
+    std::unique_ptr<FileReader> _fileReader;
+    ByteSource*         _reader     { nullptr };
+    ParserCounters      _counters;
+    MemoryResource*     _resource   { HeapResource() };
+    TagRecord           _record;                //!< Tag being parsed outside the pipelined mode
+    std::unique_ptr<TagPipeline> _pipeline;
+    bool                _bPipelining { false };  //!< The reader thread runs
+    MemoryBudget        _budget;
+    uint64_t            _lastTagEnd { 0 };      //!< Follow() resumes here
+    uint32_t            _followChunked { 0 };   //!< Payload bytes of the tag at _lastTagEnd already chunked
+    bool                _bPulling   { false };  //!< Next() has read the file header
+    bool                _bPullEnd   { false };
+    bool                _bFailed    { false };
+    bool                _bFollowing { false };
+    uint64_t            _readCallsBase { 0 };
     bool                _bHasVideo  { false };
     bool                _bHasAudio  { false };
+    bool                _bFiltering { false };
+    TagFilter           _filter;
+    // keyframe only mode
+    bool                _bKeyframesOnly { false };
+    KeyframeOptions     _keyframes;
+    bool                _bIndexLoaded   { false };  //!< onMetaData was looked at
+    std::vector<uint32_t> _indexTimes;              //!< Keyframe times in ms, by file position
+    std::vector<uint64_t> _indexPositions;          //!< Keyframe tag offsets, ascending
+    uint32_t            _keyframesPassed { 0 };     //!< Keyframes skipped since the last delivered one
+    uint32_t            _lastKeyframe   { 0 };      //!< Timestamp of the last delivered keyframe
+    bool                _bKeyframeDelivered { false };
+    bool                _bKeyframeJumped { false }; //!< Landed on a keyframe picked from the index
+};
+
+// Input iterator over the tags of a parser, for (const TagView& tag : parser.Tags())
+class TagIterator
+{
+public:
+    typedef std::input_iterator_tag     iterator_category;
+    typedef TagView                     value_type;
+    typedef ptrdiff_t                   difference_type;
+    typedef const TagView*              pointer;
+    typedef const TagView&              reference;
+
+    TagIterator() {}
+    explicit TagIterator(FLVParser* parser) : _parser(parser) { ++*this; }
+
+    const TagView&      operator* () const  { return _view; }
+    const TagView*      operator->() const  { return &_view; }
+    TagIterator&        operator++()
+    {
+        if (!_parser->Next(_view))
+            _parser = nullptr;
+        return *this;
+    }
+    bool operator== (const TagIterator& other) const { return _parser == other._parser; }
+    bool operator!= (const TagIterator& other) const { return _parser != other._parser; }
+
+private:
+    FLVParser*          _parser     { nullptr };
+    TagView             _view;
+};
+
+class TagRange
+{
+public:
+    explicit TagRange(FLVParser* parser) : _parser(parser) {}
+
+    TagIterator         begin() const       { return TagIterator(_parser); }
+    TagIterator         end() const         { return TagIterator(); }
+
+private:
+    FLVParser*          _parser;
 };
 
 class ScriptTagKVParser;
@@ -0,0 +1,793 @@
+/**
+* This file is part of FLVParser.
+
+* FLVParser is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+
+* FLVParser is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+
+* You should have received a copy of the GNU General Public License
+* along with FLVParser.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "common.h"
+#include "flvreader.h"
+
+#include <chrono>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#ifdef __linux__
+#include <sys/inotify.h>
+#endif
+
+#ifdef FLVPARSER_HAVE_IO_URING
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#endif
+
+FLVPARSER_NAMESPACE_BEGIN
+
+bool ByteSource::Skip(uint64_t size)
+{
+    if (Seek(Tell() + size))
+        return true;
+    uint8_t scratch[4096];
+    while (size > 0)
+    {
+        size_t n = size < sizeof(scratch) ? (size_t)size : sizeof(scratch);
+        if (Read(scratch, n) != n)
+            return false;
+        size -= n;
+    }
+    return true;
+}
+
+const char* ReadBackendName(ReadBackend backend)
+{
+    switch (backend)
+    {
+    case ReadBackendAuto:
+        return "auto";
+    case ReadBackendIoUring:
+        return "io_uring";
+    case ReadBackendPread:
+        return "pread";
+    default:
+        return "unknown";
+    }
+}
+
+#ifdef FLVPARSER_HAVE_IO_URING
+
+// Minimal io_uring binding on top of the raw system calls, only the
+// IORING_OP_READ path used by the read-ahead is implemented
+struct FileReader::IoUring
+{
+    int                 _fd         { -1 };
+    void*               _sqRing     { MAP_FAILED };
+    size_t              _sqRingSize { 0 };
+    void*               _cqRing     { MAP_FAILED };
+    size_t              _cqRingSize { 0 };
+    io_uring_sqe*       _sqes       { nullptr };
+    size_t              _sqesSize   { 0 };
+    unsigned*           _sqTail     { nullptr };
+    unsigned*           _sqMask     { nullptr };
+    unsigned*           _sqArray    { nullptr };
+    unsigned*           _cqHead     { nullptr };
+    unsigned*           _cqTail     { nullptr };
+    unsigned*           _cqMask     { nullptr };
+    io_uring_cqe*       _cqes       { nullptr };
+};
+
+static int IoUringSetup(unsigned entries, io_uring_params* params)
+{
+    return (int)syscall(__NR_io_uring_setup, entries, params);
+}
+
+static int IoUringEnter(int fd, unsigned toSubmit, unsigned minComplete, unsigned flags)
+{
+    return (int)syscall(__NR_io_uring_enter, fd, toSubmit, minComplete, flags, nullptr, 0);
+}
+
+bool FileReader::SetupIoUring()
+{
+    io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    int fd = IoUringSetup(_blocks.size(), &params);
+    if (fd < 0)
+        return false;
+
+    IoUring* ring = new IoUring;
+    ring->_fd = fd;
+    ring->_sqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    ring->_cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    if (params.features & IORING_FEAT_SINGLE_MMAP)
+    {
+        if (ring->_cqRingSize > ring->_sqRingSize)
+            ring->_sqRingSize = ring->_cqRingSize;
+        ring->_cqRingSize = ring->_sqRingSize;
+    }
+    ring->_sqRing = mmap(nullptr, ring->_sqRingSize, PROT_READ | PROT_WRITE,
+                         MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+    if (ring->_sqRing == MAP_FAILED)
+    {
+        _ring = ring;
+        TeardownIoUring();
+        return false;
+    }
+    if (params.features & IORING_FEAT_SINGLE_MMAP)
+    {
+        ring->_cqRing = ring->_sqRing;
+    }
+    else
+    {
+        ring->_cqRing = mmap(nullptr, ring->_cqRingSize, PROT_READ | PROT_WRITE,
+                             MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+        if (ring->_cqRing == MAP_FAILED)
+        {
+            _ring = ring;
+            TeardownIoUring();
+            return false;
+        }
+    }
+    ring->_sqesSize = params.sq_entries * sizeof(io_uring_sqe);
+    void* sqes = mmap(nullptr, ring->_sqesSize, PROT_READ | PROT_WRITE,
+                      MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+    if (sqes == MAP_FAILED)
+    {
+        _ring = ring;
+        TeardownIoUring();
+        return false;
+    }
+    ring->_sqes = (io_uring_sqe*)sqes;
+
+    uint8_t* sq = (uint8_t*)ring->_sqRing;
+    uint8_t* cq = (uint8_t*)ring->_cqRing;
+    ring->_sqTail  = (unsigned*)(sq + params.sq_off.tail);
+    ring->_sqMask  = (unsigned*)(sq + params.sq_off.ring_mask);
+    ring->_sqArray = (unsigned*)(sq + params.sq_off.array);
+    ring->_cqHead  = (unsigned*)(cq + params.cq_off.head);
+    ring->_cqTail  = (unsigned*)(cq + params.cq_off.tail);
+    ring->_cqMask  = (unsigned*)(cq + params.cq_off.ring_mask);
+    ring->_cqes    = (io_uring_cqe*)(cq + params.cq_off.cqes);
+    _ring = ring;
+    return true;
+}
+
+void FileReader::TeardownIoUring()
+{
+    if (!_ring)
+        return;
+    if (_ring->_sqes)
+        munmap(_ring->_sqes, _ring->_sqesSize);
+    if (_ring->_cqRing != MAP_FAILED && _ring->_cqRing != _ring->_sqRing)
+        munmap(_ring->_cqRing, _ring->_cqRingSize);
+    if (_ring->_sqRing != MAP_FAILED)
+        munmap(_ring->_sqRing, _ring->_sqRingSize);
+    if (_ring->_fd >= 0)
+        close(_ring->_fd);
+    delete _ring;
+    _ring = nullptr;
+}
+
+bool FileReader::SubmitBlock(size_t index)
+{
+    Block& block = _blocks[index];
+    unsigned tail = *_ring->_sqTail;
+    unsigned slot = tail & *_ring->_sqMask;
+    io_uring_sqe* sqe = &_ring->_sqes[slot];
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->opcode = IORING_OP_READ;
+    sqe->fd = _fd;
+    sqe->off = block._offset;
+    sqe->addr = (uint64_t)(uintptr_t)block._buffer;
+    sqe->len = (uint32_t)_blockSize;
+    sqe->user_data = index;
+    _ring->_sqArray[slot] = slot;
+    __atomic_store_n(_ring->_sqTail, tail + 1, __ATOMIC_RELEASE);
+    block._bPending = true;
+    FLVPARSER_STATS(_readCalls++);
+    if (IoUringEnter(_ring->_fd, 1, 0, 0) < 0)
+    {
+        std::cerr << "[failed]: io_uring_enter submit failed: " << strerror(errno) << std::endl;
+        return false;
+    }
+    return true;
+}
+
+bool FileReader::WaitBlock(size_t index)
+{
+    while (_blocks[index]._bPending)
+    {
+        unsigned head = *_ring->_cqHead;
+        if (head == __atomic_load_n(_ring->_cqTail, __ATOMIC_ACQUIRE))
+        {
+            FLVPARSER_STATS(_readCalls++);
+            if (IoUringEnter(_ring->_fd, 0, 1, IORING_ENTER_GETEVENTS) < 0 && errno != EINTR)
+            {
+                std::cerr << "[failed]: io_uring_enter wait failed: " << strerror(errno) << std::endl;
+                return false;
+            }
+            continue;
+        }
+        io_uring_cqe* cqe = &_ring->_cqes[head & *_ring->_cqMask];
+        Block& done = _blocks[cqe->user_data];
+        int res = cqe->res;
+        __atomic_store_n(_ring->_cqHead, head + 1, __ATOMIC_RELEASE);
+
+        done._bPending = false;
+        done._length = res > 0 ? (size_t)res : 0;
+        if (res == -EINVAL && !_bWarned)
+        {
+            // kernels before 5.6 set up the ring but reject IORING_OP_READ
+            std::cerr << "[warning]: io_uring rejected the read request, "
+                "finishing reads with pread" << std::endl;
+            _bWarned = true;
+        }
+        // finish short or failed reads synchronously, the tail of the file
+        // is the only place a short read is expected
+        uint64_t expected = _fileSize - done._offset;
+        if (expected > _blockSize)
+            expected = _blockSize;
+        while (done._length < expected)
+        {
+            FLVPARSER_STATS(_readCalls++);
+            ssize_t n = pread(_fd, done._buffer + done._length,
+                              expected - done._length, done._offset + done._length);
+            if (n <= 0)
+            {
+                if (n < 0 && errno == EINTR)
+                    continue;
+                break;
+            }
+            done._length += (size_t)n;
+        }
+    }
+    return true;
+}
+
+#else
+
+struct FileReader::IoUring
+{
+};
+
+bool FileReader::SetupIoUring()
+{
+    return false;
+}
+
+void FileReader::TeardownIoUring()
+{
+}
+
+bool FileReader::SubmitBlock(size_t)
+{
+    return false;
+}
+
+bool FileReader::WaitBlock(size_t)
+{
+    return false;
+}
+
+#endif // FLVPARSER_HAVE_IO_URING
+
+FileReader::FileReader(const char* path, const ReadOptions& options)
+{
+    if (!path)
+    {
+        std::cerr << "[failed]: input file path is null" << std::endl;
+        throw "[failed]";
+    }
+    _fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (_fd < 0)
+    {
+        std::cerr << "[failed]: could not open the " << path <<
+            " maybe the file location is invalid" << std::endl;
+        throw "[failed]: throw exception";
+    }
+    struct stat st;
+    if (fstat(_fd, &st) == 0)
+        _fileSize = (uint64_t)st.st_size;
+
+    _blockSize = options._blockSize ? options._blockSize : (1 << 20);
+    _resource = options._resource ? options._resource : HeapResource();
+    size_t depth = options._queueDepth ? options._queueDepth : 1;
+    if (options._backend != ReadBackendPread)
+    {
+        _blocks.resize(depth);
+        if (SetupIoUring())
+        {
+            _backend = ReadBackendIoUring;
+        }
+        else if (options._backend == ReadBackendIoUring)
+        {
+            std::cerr << "[warning]: io_uring is unavailable, falling back to pread" << std::endl;
+        }
+    }
+    if (_backend == ReadBackendPread)
+    {
+        _blocks.resize(1);
+#ifdef POSIX_FADV_SEQUENTIAL
+        posix_fadvise(_fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+    }
+    for (size_t idx = 0; idx < _blocks.size(); idx++)
+    {
+        _blocks[idx]._buffer = static_cast<uint8_t*>(_resource->Allocate(_blockSize));
+    }
+}
+
+FileReader::~FileReader()
+{
+    if (_ring)
+    {
+        for (size_t idx = 0; idx < _blocks.size(); idx++)
+            WaitBlock(idx);
+        TeardownIoUring();
+    }
+    for (size_t idx = 0; idx < _blocks.size(); idx++)
+    {
+        if (_blocks[idx]._buffer)
+            _resource->Deallocate(_blocks[idx]._buffer, _blockSize);
+    }
+    if (_fd >= 0)
+    {
+        close(_fd);
+        _fd = -1;
+    }
+}
+
+uint64_t FileReader::Tell() const
+{
+    if (!_bStarted)
+        return _nextOffset;
+    uint64_t offset = _blocks[_current]._offset + _position;
+    return offset < _fileSize ? offset : _fileSize;
+}
+
+bool FileReader::Seek(uint64_t offset)
+{
+    if (_bStarted)
+    {
+        // stay inside the block already in memory when possible
+        const Block& block = _blocks[_current];
+        if (offset >= block._offset && offset < block._offset + block._length)
+        {
+            _position = (size_t)(offset - block._offset);
+            _bEof = false;
+            return true;
+        }
+        // forward seeks into the read-ahead window consume blocks instead
+        // of throwing the in-flight reads away: they have to complete before
+        // their buffers can be reused anyway, and restarting the ring at the
+        // target would read the overlap with the old window a second time
+        if (_ring && offset > block._offset && offset < _nextOffset)
+        {
+            while (offset >= _blocks[_current]._offset + _blocks[_current]._length)
+            {
+                if (!NextBlock())
+                    break;
+            }
+            const Block& reached = _blocks[_current];
+            if (offset >= reached._offset && offset < reached._offset + reached._length)
+            {
+                _position = (size_t)(offset - reached._offset);
+                _bEof = false;
+                return true;
+            }
+        }
+    }
+    if (_ring)
+    {
+        for (size_t idx = 0; idx < _blocks.size(); idx++)
+            WaitBlock(idx);
+    }
+    for (size_t idx = 0; idx < _blocks.size(); idx++)
+    {
+        _blocks[idx]._offset = 0;
+        _blocks[idx]._length = 0;
+    }
+    _current    = 0;
+    _position   = 0;
+    _nextOffset = offset;
+    _bStarted   = false;
+    _bEof       = false;
+    return true;
+}
+
+bool FileReader::NextBlock()
+{
+    if (!_ring)
+    {
+        Block& block = _blocks[0];
+        block._offset = _nextOffset;
+        block._length = 0;
+        while (true)
+        {
+            FLVPARSER_STATS(_readCalls++);
+            ssize_t n = pread(_fd, block._buffer, _blockSize, block._offset);
+            if (n < 0 && errno == EINTR)
+                continue;
+            if (n < 0)
+                std::cerr << "[failed]: pread failed: " << strerror(errno) << std::endl;
+            else
+                block._length = (size_t)n;
+            break;
+        }
+        _nextOffset += block._length;
+        _position = 0;
+        _bStarted = true;
+        return block._length > 0;
+    }
+
+    if (!_bStarted)
+    {
+        for (size_t idx = 0; idx < _blocks.size(); idx++)
+        {
+            Block& block = _blocks[idx];
+            block._offset = _nextOffset;
+            block._length = 0;
+            _nextOffset += _blockSize;
+            if (block._offset < _fileSize && !SubmitBlock(idx))
+                return false;
+        }
+        _bStarted = true;
+    }
+    else
+    {
+        // hand the consumed block back to the kernel for the next read
+        Block& done = _blocks[_current];
+        done._offset = _nextOffset;
+        done._length = 0;
+        _nextOffset += _blockSize;
+        if (done._offset < _fileSize && !SubmitBlock(_current))
+            return false;
+        _current = (_current + 1) % _blocks.size();
+    }
+    _position = 0;
+    if (!WaitBlock(_current))
+        return false;
+    return _blocks[_current]._length > 0;
+}
+
+size_t FileReader::Read(void* buffer, size_t size)
+{
+    uint8_t* out = static_cast<uint8_t*>(buffer);
+    size_t copied = 0;
+    while (copied < size)
+    {
+        Block& block = _blocks[_current];
+        if (!_bStarted || _position >= block._length)
+        {
+            if (!NextBlock())
+            {
+                _bEof = true;
+                break;
+            }
+            continue;
+        }
+        size_t n = block._length - _position;
+        if (n > size - copied)
+            n = size - copied;
+        memcpy(out + copied, block._buffer + _position, n);
+        _position += n;
+        copied += n;
+    }
+    return copied;
+}
+
+MemorySource::MemorySource(const void* data, size_t size)
+                : _data(static_cast<const uint8_t*>(data)),
+                  _size(data ? size : 0)
+{
+
+}
+
+size_t MemorySource::Read(void* buffer, size_t size)
+{
+    size_t n = _size - _position;
+    if (n < size)
+        _bEof = true;
+    else
+        n = size;
+    memcpy(buffer, _data + _position, n);
+    _position += n;
+    return n;
+}
+
+bool MemorySource::Seek(uint64_t offset)
+{
+    if (offset > _size)
+        return false;
+    _position = (size_t)offset;
+    _bEof = false;
+    return true;
+}
+
+const uint8_t* MemorySource::Borrow(size_t size)
+{
+    if (_size - _position < size)
+        return nullptr;
+    const uint8_t* data = _data + _position;
+    _position += size;
+    return data;
+}
+
+FdSource::FdSource(int fd, bool bOwnsFd, size_t bufferSize)
+                : _fd(fd),
+                  _bOwnsFd(bOwnsFd),
+                  _buffer(bufferSize ? bufferSize : 64 * 1024)
+{
+    if (_fd < 0)
+    {
+        std::cerr << "[failed]: input file descriptor is invalid" << std::endl;
+        throw "[failed]";
+    }
+    // a regular file read from its start, e.g. redirected stdin
+    struct stat st;
+    if (lseek(_fd, 0, SEEK_CUR) == 0 && fstat(_fd, &st) == 0 && S_ISREG(st.st_mode))
+        _size = st.st_size;
+}
+
+FdSource::~FdSource()
+{
+    if (_bOwnsFd && _fd >= 0)
+    {
+        close(_fd);
+        _fd = -1;
+    }
+}
+
+size_t FdSource::Read(void* buffer, size_t size)
+{
+    uint8_t* out = static_cast<uint8_t*>(buffer);
+    size_t copied = 0;
+    while (copied < size)
+    {
+        if (_begin == _end)
+        {
+            // large reads bypass the buffer
+            size_t want = size - copied;
+            bool bDirect = want >= _buffer.size();
+            FLVPARSER_STATS(_readCalls++);
+            ssize_t n = read(_fd, bDirect ? out + copied : _buffer.data(),
+                             bDirect ? want : _buffer.size());
+            if (n < 0 && errno == EINTR)
+                continue;
+            if (n <= 0)
+            {
+                if (n < 0)
+                    std::cerr << "[failed]: read failed: " << strerror(errno) << std::endl;
+                _bEof = true;
+                break;
+            }
+            if (bDirect)
+            {
+                copied += (size_t)n;
+                _offset += (size_t)n;
+                continue;
+            }
+            _begin = 0;
+            _end = (size_t)n;
+        }
+        size_t n = _end - _begin;
+        if (n > size - copied)
+            n = size - copied;
+        memcpy(out + copied, _buffer.data() + _begin, n);
+        _begin += n;
+        _offset += n;
+        copied += n;
+    }
+    return copied;
+}
+
+bool FdSource::Seek(uint64_t offset)
+{
+    if (lseek(_fd, (off_t)offset, SEEK_SET) < 0)
+        return false;
+    _begin = _end = 0;
+    _offset = offset;
+    _bEof = false;
+    return true;
+}
+
+CallbackSource::CallbackSource(ByteReader reader)
+                : _reader(reader)
+{
+
+}
+
+size_t CallbackSource::Read(void* buffer, size_t size)
+{
+    uint8_t* out = static_cast<uint8_t*>(buffer);
+    size_t copied = 0;
+    while (copied < size)
+    {
+        FLVPARSER_STATS(_readCalls++);
+        size_t n = _reader(out + copied, size - copied);
+        if (n == 0)
+        {
+            _bEof = true;
+            break;
+        }
+        copied += n;
+    }
+    _offset += copied;
+    return copied;
+}
+
+static uint64_t NowMs()
+{
+    return std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+FollowSource::FollowSource(const char* path, const FollowOptions& options)
+                : _options(options),
+                  _buffer(options._bufferSize ? options._bufferSize : 256 * 1024)
+{
+    if (!path)
+    {
+        std::cerr << "[failed]: input file path is null" << std::endl;
+        throw "[failed]";
+    }
+    _fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (_fd < 0)
+    {
+        std::cerr << "[failed]: could not open the " << path <<
+            " maybe the file location is invalid" << std::endl;
+        throw "[failed]: throw exception";
+    }
+    if (pipe(_stopPipe) != 0)
+    {
+        close(_fd);
+        std::cerr << "[failed]: could not create the stop pipe" << std::endl;
+        throw "[failed]";
+    }
+    fcntl(_stopPipe[0], F_SETFL, O_NONBLOCK);
+    fcntl(_stopPipe[1], F_SETFL, O_NONBLOCK);
+#ifdef __linux__
+    if (_options._bInotify)
+    {
+        _inotifyFd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+        if (_inotifyFd >= 0 &&
+            inotify_add_watch(_inotifyFd, path, IN_MODIFY | IN_CLOSE_WRITE) < 0)
+        {
+            close(_inotifyFd);
+            _inotifyFd = -1;
+        }
+    }
+#endif
+}
+
+FollowSource::~FollowSource()
+{
+    if (_inotifyFd >= 0)
+        close(_inotifyFd);
+    if (_stopPipe[0] >= 0)
+        close(_stopPipe[0]);
+    if (_stopPipe[1] >= 0)
+        close(_stopPipe[1]);
+    if (_fd >= 0)
+    {
+        close(_fd);
+        _fd = -1;
+    }
+}
+
+void FollowSource::Stop()
+{
+    _bStop = true;
+    char wake = 1;
+    ssize_t ret = write(_stopPipe[1], &wake, 1);
+    (void)ret;
+}
+
+bool FollowSource::Seek(uint64_t offset)
+{
+    _begin = _end = 0;
+    _offset = offset;
+    _bEof = false;
+    return true;
+}
+
+size_t FollowSource::Fill()
+{
+    // drain the notifications first, writes after this point wake poll()
+    if (_inotifyFd >= 0)
+    {
+        char events[4096];
+        while (read(_inotifyFd, events, sizeof(events)) > 0)
+            ;
+    }
+    while (true)
+    {
+        FLVPARSER_STATS(_readCalls++);
+        ssize_t n = pread(_fd, _buffer.data(), _buffer.size(), _offset);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n < 0)
+        {
+            std::cerr << "[failed]: pread failed: " << strerror(errno) << std::endl;
+            return 0;
+        }
+        _begin = 0;
+        _end = (size_t)n;
+        return _end;
+    }
+}
+
+bool FollowSource::WaitForData(uint64_t idleSinceMs)
+{
+    if (_bStop)
+        return false;
+    int timeout = (int)_options._pollIntervalMs;
+    if (_options._idleTimeoutMs)
+    {
+        uint64_t idle = NowMs() - idleSinceMs;
+        if (idle >= _options._idleTimeoutMs)
+            return false;
+        if (_options._idleTimeoutMs - idle < (uint64_t)timeout)
+            timeout = (int)(_options._idleTimeoutMs - idle);
+    }
+    struct pollfd fds[2];
+    int count = 0;
+    fds[count].fd = _stopPipe[0];
+    fds[count].events = POLLIN;
+    count++;
+    if (_inotifyFd >= 0)
+    {
+        fds[count].fd = _inotifyFd;
+        fds[count].events = POLLIN;
+        count++;
+    }
+    poll(fds, count, timeout);
+    return !_bStop;
+}
+
+size_t FollowSource::Read(void* buffer, size_t size)
+{
+    uint8_t* out = static_cast<uint8_t*>(buffer);
+    size_t copied = 0;
+    uint64_t idleSince = NowMs();
+    while (copied < size)
+    {
+        if (_begin == _end)
+        {
+            if (Fill() > 0)
+            {
+                idleSince = NowMs();
+                continue;
+            }
+            if (!WaitForData(idleSince))
+            {
+                _bEof = true;
+                break;
+            }
+            continue;
+        }
+        size_t n = _end - _begin;
+        if (n > size - copied)
+            n = size - copied;
+        memcpy(out + copied, _buffer.data() + _begin, n);
+        _begin += n;
+        _offset += n;
+        copied += n;
+    }
+    return copied;
+}
+
+FLVPARSER_NAMESPACE_END
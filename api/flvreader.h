@@ -0,0 +1,247 @@
+/**
+* This file is part of FLVParser.
+
+* FLVParser is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+
+* FLVParser is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+
+* You should have received a copy of the GNU General Public License
+* along with FLVParser.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef FLVREADER_H_
+#define FLVREADER_H_
+
+#include "common.h"
+#include "flvmemory.h"
+
+#include <atomic>
+#include <functional>
+#include <stddef.h>
+#include <vector>
+
+FLVPARSER_NAMESPACE_BEGIN
+
+enum ReadBackend
+{
+    ReadBackendAuto = 0,                    //!< io_uring when available, pread otherwise
+    ReadBackendIoUring,
+    ReadBackendPread
+};
+
+struct ReadOptions
+{
+    ReadBackend     _backend    { ReadBackendAuto };
+    uint32_t        _queueDepth { 4 };          //!< Number of blocks kept in flight
+    uint32_t        _blockSize  { 1 << 20 };    //!< Size of every block read in bytes
+    MemoryResource* _resource   { nullptr };    //!< Read blocks and parser buffers, nullptr is the heap
+};
+
+const char* ReadBackendName(ReadBackend backend);
+
+// Byte source the parser pulls its input from. Read() returns the number of
+// bytes copied, a short count means the end of the input (or an error) was
+// reached and Eof() turns true. Sources that keep the whole input in stable
+// memory hand payloads out through Borrow() without copying them.
+class ByteSource
+{
+public:
+    virtual ~ByteSource() {}
+
+    virtual size_t          Read(void* buffer, size_t size) = 0;
+    virtual bool            Eof() const = 0;
+    virtual uint64_t        Tell() const = 0;
+    virtual bool            Rewind() { return Seek(0); }
+    virtual bool            Seek(uint64_t) { return false; }
+    virtual bool            Skip(uint64_t size);
+    //! Pointer to the next size bytes, valid as long as the source lives,
+    //! or nullptr when the source can not lend its memory
+    virtual const uint8_t*  Borrow(size_t) { return nullptr; }
+    //! Total input size in bytes, 0 when it is unknown or still growing
+    virtual uint64_t        Size() const { return 0; }
+
+    //! Number of read system calls (or reader invocations) issued so far,
+    //! only counted when built with PARSER_STATS
+    uint64_t                ReadCalls() const { return _readCalls; }
+
+protected:
+    uint64_t                _readCalls { 0 };
+};
+
+// Sequential file reader with read-ahead. The io_uring backend keeps
+// _queueDepth block reads in flight so parsing overlaps with I/O, the pread
+// backend reads one block at a time and is used whenever io_uring cannot be
+// set up (old kernels, seccomp filters, build without the kernel headers).
+// In-flight reads cannot be taken back, so a forward Seek() inside the
+// read-ahead window still reads the bytes it jumps over; only the pread
+// backend reads nothing but the block holding the target.
+class FileReader : public ByteSource
+{
+public:
+    FileReader(const char* path, const ReadOptions& options = ReadOptions());
+    ~FileReader();
+
+    FileReader(const FileReader&)               = delete;
+    FileReader& operator= (const FileReader&)   = delete;
+
+    size_t              Read(void* buffer, size_t size) override;
+    bool                Eof() const override { return _bEof; }
+    uint64_t            Tell() const override;
+    bool                Seek(uint64_t offset) override;
+    uint64_t            Size() const override { return _fileSize; }
+    ReadBackend         Backend() const { return _backend; }
+    uint64_t            FileSize() const { return _fileSize; }
+
+private:
+    struct Block
+    {
+        uint8_t*        _buffer { nullptr };
+        uint64_t        _offset { 0 };
+        size_t          _length { 0 };
+        bool            _bPending { false };
+    };
+
+    bool                SetupIoUring();
+    void                TeardownIoUring();
+    bool                SubmitBlock(size_t index);
+    bool                WaitBlock(size_t index);
+    bool                NextBlock();
+
+    int                 _fd         { -1 };
+    uint64_t            _fileSize   { 0 };
+    ReadBackend         _backend    { ReadBackendPread };
+    size_t              _blockSize  { 0 };
+    MemoryResource*     _resource   { nullptr };
+    std::vector<Block>  _blocks;
+    size_t              _current    { 0 };      //!< Block being consumed
+    size_t              _position   { 0 };      //!< Position inside the current block
+    uint64_t            _nextOffset { 0 };      //!< File offset of the next block to request
+    bool                _bStarted   { false };
+    bool                _bEof       { false };
+    bool                _bWarned    { false };      //!< io_uring -EINVAL fallback reported
+
+    struct IoUring;
+    IoUring*            _ring       { nullptr };
+};
+
+// In-memory input, nothing is copied or allocated: payloads are borrowed
+// straight from the caller's buffer, which must outlive the parser
+class MemorySource : public ByteSource
+{
+public:
+    MemorySource(const void* data, size_t size);
+
+    size_t              Read(void* buffer, size_t size) override;
+    bool                Eof() const override { return _bEof; }
+    uint64_t            Tell() const override { return _position; }
+    bool                Seek(uint64_t offset) override;
+    const uint8_t*      Borrow(size_t size) override;
+    uint64_t            Size() const override { return _size; }
+
+private:
+    const uint8_t*      _data;
+    size_t              _size;
+    size_t              _position   { 0 };
+    bool                _bEof       { false };
+};
+
+// Buffered reads from a file descriptor, used for pipes and stdin.
+// Seeking only works when the descriptor itself is seekable.
+class FdSource : public ByteSource
+{
+public:
+    FdSource(int fd, bool bOwnsFd = false, size_t bufferSize = 64 * 1024);
+    ~FdSource();
+
+    FdSource(const FdSource&)               = delete;
+    FdSource& operator= (const FdSource&)   = delete;
+
+    size_t              Read(void* buffer, size_t size) override;
+    bool                Eof() const override { return _bEof; }
+    uint64_t            Tell() const override { return _offset; }
+    bool                Seek(uint64_t offset) override;
+    uint64_t            Size() const override { return _size; }
+
+private:
+    int                 _fd;
+    bool                _bOwnsFd;
+    uint64_t            _size       { 0 };      //!< Known for regular files only
+    std::vector<uint8_t> _buffer;
+    size_t              _begin      { 0 };
+    size_t              _end        { 0 };
+    uint64_t            _offset     { 0 };
+    bool                _bEof       { false };
+};
+
+// User-provided reader: returns the number of bytes written to the buffer,
+// 0 at the end of the input
+using ByteReader = std::function<size_t(void*, size_t)>;
+
+class CallbackSource : public ByteSource
+{
+public:
+    explicit CallbackSource(ByteReader reader);
+
+    size_t              Read(void* buffer, size_t size) override;
+    bool                Eof() const override { return _bEof; }
+    uint64_t            Tell() const override { return _offset; }
+
+private:
+    ByteReader          _reader;
+    uint64_t            _offset     { 0 };
+    bool                _bEof       { false };
+};
+
+struct FollowOptions
+{
+    uint32_t        _idleTimeoutMs  { 0 };          //!< Give up after that long without new data, 0 waits forever
+    uint32_t        _pollIntervalMs { 100 };        //!< Re-check period, the only wake-up without inotify
+    bool            _bInotify       { true };       //!< Wake up on inotify events when available
+    size_t          _bufferSize     { 256 * 1024 };
+};
+
+// File still being written: reads block at the current end of the file
+// until more data shows up, the idle timeout expires or Stop() is called.
+// Only then a short count is returned and Eof() turns true.
+class FollowSource : public ByteSource
+{
+public:
+    FollowSource(const char* path, const FollowOptions& options = FollowOptions());
+    ~FollowSource();
+
+    FollowSource(const FollowSource&)               = delete;
+    FollowSource& operator= (const FollowSource&)   = delete;
+
+    size_t              Read(void* buffer, size_t size) override;
+    bool                Eof() const override { return _bEof; }
+    uint64_t            Tell() const override { return _offset; }
+    bool                Seek(uint64_t offset) override;
+
+    //! Wake up a blocked reader and stop waiting, callable from any thread
+    void                Stop();
+
+private:
+    size_t              Fill();
+    bool                WaitForData(uint64_t idleSinceMs);
+
+    FollowOptions       _options;
+    int                 _fd             { -1 };
+    int                 _inotifyFd      { -1 };
+    int                 _stopPipe[2]    { -1, -1 };
+    std::atomic<bool>   _bStop          { false };
+    std::vector<uint8_t> _buffer;
+    size_t              _begin          { 0 };
+    size_t              _end            { 0 };
+    uint64_t            _offset         { 0 };  //!< Offset of the next byte handed out
+    bool                _bEof           { false };
+};
+
+FLVPARSER_NAMESPACE_END
+
+#endif // FLVREADER_H_
@@ -0,0 +1,813 @@
+/**
+* This file is part of FLVParser.
+
+* FLVParser is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+
+* FLVParser is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+
+* You should have received a copy of the GNU General Public License
+* along with FLVParser.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "common.h"
+#include "flvremux.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+FLVPARSER_NAMESPACE_BEGIN
+
+static const uint32_t kSampleSync       = 0x02000000;   //!< sample_depends_on = 2
+static const uint32_t kSampleNonSync    = 0x01010000;   //!< depends on others, non sync sample
+static const uint32_t kAACFrameSamples  = 1024;
+static const size_t kWindowInitial      = 4 << 20;
+static const uint32_t kAudioOnlyFragmentMs = 1000;
+
+static const uint32_t kAACSampleRates[] = {
+    96000, 88200, 64000, 48000, 44100, 32000, 24000, 22050, 16000, 12000, 11025, 8000, 7350
+};
+
+// Big endian box serialization with the box size patched on End()
+class BoxBuffer
+{
+public:
+    explicit BoxBuffer(std::vector<uint8_t>& data) : _data(data) {}
+
+    void U8(uint32_t value)     { _data.push_back((uint8_t)value); }
+    void U16(uint32_t value)    { U8(value >> 8); U8(value); }
+    void U24(uint32_t value)    { U8(value >> 16); U16(value); }
+    void U32(uint32_t value)    { U16(value >> 16); U16(value); }
+    void U64(uint64_t value)    { U32((uint32_t)(value >> 32)); U32((uint32_t)value); }
+    void Zeros(size_t size)     { _data.insert(_data.end(), size, 0); }
+    void Bytes(const void* data, size_t size)
+    {
+        const uint8_t* bytes = static_cast<const uint8_t*>(data);
+        _data.insert(_data.end(), bytes, bytes + size);
+    }
+
+    size_t Begin(const char* type)
+    {
+        size_t at = _data.size();
+        U32(0);
+        Bytes(type, 4);
+        return at;
+    }
+
+    size_t BeginFull(const char* type, uint8_t version, uint32_t flags)
+    {
+        size_t at = Begin(type);
+        U8(version);
+        U24(flags);
+        return at;
+    }
+
+    void End(size_t at)         { Patch(at, (uint32_t)(_data.size() - at)); }
+
+    void Patch(size_t at, uint32_t value)
+    {
+        _data[at] = (uint8_t)(value >> 24);
+        _data[at + 1] = (uint8_t)(value >> 16);
+        _data[at + 2] = (uint8_t)(value >> 8);
+        _data[at + 3] = (uint8_t)value;
+    }
+
+    size_t Size() const         { return _data.size(); }
+
+    //! Unity transformation matrix of mvhd and tkhd
+    void Matrix()
+    {
+        const uint32_t matrix[9] = { 0x00010000, 0, 0, 0, 0x00010000, 0, 0, 0, 0x40000000 };
+        for (int idx = 0; idx < 9; idx++)
+            U32(matrix[idx]);
+    }
+
+    //! MPEG-4 descriptor header with a four bytes size
+    void Descriptor(uint8_t tag, uint32_t size)
+    {
+        U8(tag);
+        U8(0x80 | ((size >> 21) & 0x7F));
+        U8(0x80 | ((size >> 14) & 0x7F));
+        U8(0x80 | ((size >> 7) & 0x7F));
+        U8(size & 0x7F);
+    }
+
+private:
+    std::vector<uint8_t>& _data;
+};
+
+// Exp-Golomb reader over an RBSP, emulation prevention bytes already removed
+class BitReader
+{
+public:
+    BitReader(const uint8_t* data, size_t size) : _data(data), _size(size) {}
+
+    uint32_t Bits(int count)
+    {
+        uint32_t value = 0;
+        while (count-- > 0)
+        {
+            if (_bit >= _size * 8)
+            {
+                _bOk = false;
+                return 0;
+            }
+            value = (value << 1) | ((_data[_bit >> 3] >> (7 - (_bit & 7))) & 1);
+            _bit++;
+        }
+        return value;
+    }
+
+    uint32_t Ue()
+    {
+        int zeros = 0;
+        while (Bits(1) == 0 && _bOk && zeros < 32)
+            zeros++;
+        return ((1u << zeros) - 1) + Bits(zeros);
+    }
+
+    int32_t Se()
+    {
+        uint32_t value = Ue();
+        return (value & 1) ? (int32_t)((value + 1) / 2) : -(int32_t)(value / 2);
+    }
+
+    bool Ok() const     { return _bOk; }
+
+private:
+    const uint8_t*  _data;
+    size_t          _size;
+    size_t          _bit    { 0 };
+    bool            _bOk    { true };
+};
+
+static void SkipScalingList(BitReader& bits, int size)
+{
+    int32_t last = 8;
+    int32_t next = 8;
+    for (int idx = 0; idx < size && bits.Ok(); idx++)
+    {
+        if (next != 0)
+            next = (last + bits.Se() + 256) % 256;
+        last = next == 0 ? last : next;
+    }
+}
+
+// Coded size minus the cropping of the first SPS in an AVCDecoderConfigurationRecord
+static bool ParseAVCDimensions(const uint8_t* config, size_t size, uint32_t& width, uint32_t& height)
+{
+    if (size < 8 || (config[5] & 0x1F) == 0)
+        return false;
+    size_t spsSize = ((size_t)config[6] << 8) | config[7];
+    if (8 + spsSize > size || spsSize < 4)
+        return false;
+    std::vector<uint8_t> rbsp;
+    const uint8_t* nal = config + 8;
+    for (size_t idx = 1; idx < spsSize; idx++)
+    {
+        if (idx >= 3 && nal[idx] == 3 && nal[idx - 1] == 0 && nal[idx - 2] == 0)
+            continue;
+        rbsp.push_back(nal[idx]);
+    }
+
+    BitReader bits(rbsp.data(), rbsp.size());
+    uint32_t profile = bits.Bits(8);
+    bits.Bits(16);                              // constraint flags, level
+    bits.Ue();                                  // seq_parameter_set_id
+    uint32_t chromaFormat = 1;
+    bool bSeparatePlanes = false;
+    if (profile == 100 || profile == 110 || profile == 122 || profile == 244 || profile == 44 ||
+        profile == 83 || profile == 86 || profile == 118 || profile == 128 || profile == 138 ||
+        profile == 139 || profile == 134 || profile == 135)
+    {
+        chromaFormat = bits.Ue();
+        if (chromaFormat == 3)
+            bSeparatePlanes = bits.Bits(1) != 0;
+        bits.Ue();                              // bit_depth_luma_minus8
+        bits.Ue();                              // bit_depth_chroma_minus8
+        bits.Bits(1);                           // qpprime_y_zero_transform_bypass_flag
+        if (bits.Bits(1))
+        {
+            for (int idx = 0; idx < (chromaFormat == 3 ? 12 : 8) && bits.Ok(); idx++)
+            {
+                if (bits.Bits(1))
+                    SkipScalingList(bits, idx < 6 ? 16 : 64);
+            }
+        }
+    }
+    bits.Ue();                                  // log2_max_frame_num_minus4
+    uint32_t pocType = bits.Ue();
+    if (pocType == 0)
+    {
+        bits.Ue();
+    }
+    else if (pocType == 1)
+    {
+        bits.Bits(1);
+        bits.Se();
+        bits.Se();
+        uint32_t cycle = bits.Ue();
+        for (uint32_t idx = 0; idx < cycle && bits.Ok(); idx++)
+            bits.Se();
+    }
+    bits.Ue();                                  // max_num_ref_frames
+    bits.Bits(1);                               // gaps_in_frame_num_value_allowed_flag
+    uint32_t widthInMbs = bits.Ue() + 1;
+    uint32_t heightInMapUnits = bits.Ue() + 1;
+    uint32_t frameMbsOnly = bits.Bits(1);
+    if (!frameMbsOnly)
+        bits.Bits(1);                           // mb_adaptive_frame_field_flag
+    bits.Bits(1);                               // direct_8x8_inference_flag
+    uint32_t crop[4] = { 0, 0, 0, 0 };
+    if (bits.Bits(1))
+    {
+        for (int idx = 0; idx < 4; idx++)
+            crop[idx] = bits.Ue();
+    }
+    if (!bits.Ok())
+        return false;
+
+    uint32_t cropX = 1;
+    uint32_t cropY = 2 - frameMbsOnly;
+    if (!bSeparatePlanes && chromaFormat != 0)
+    {
+        cropX = chromaFormat == 3 ? 1 : 2;
+        cropY *= chromaFormat == 1 ? 2 : 1;
+    }
+    width = widthInMbs * 16 - (crop[0] + crop[1]) * cropX;
+    height = (2 - frameMbsOnly) * heightInMapUnits * 16 - (crop[2] + crop[3]) * cropY;
+    return true;
+}
+
+static bool ParseAudioSpecificConfig(const uint8_t* config, size_t size, uint32_t& sampleRate, uint8_t& channels)
+{
+    BitReader bits(config, size);
+    if (bits.Bits(5) == 31)
+        bits.Bits(6);
+    uint32_t index = bits.Bits(4);
+    if (index == 0x0F)
+        sampleRate = bits.Bits(24);
+    else if (index < sizeof(kAACSampleRates) / sizeof(kAACSampleRates[0]))
+        sampleRate = kAACSampleRates[index];
+    else
+        return false;
+    channels = (uint8_t)bits.Bits(4);
+    return bits.Ok() && sampleRate > 0;
+}
+
+FMP4Remuxer::FMP4Remuxer(const char* outputFile, const RemuxOptions& options)
+                : _writer(outputFile),
+                  _options(options)
+{
+    if (_options._maxFragmentBytes < (1 << 20))
+        _options._maxFragmentBytes = 1 << 20;
+    // mdat sizes are written with 32 bits
+    if (_options._maxFragmentBytes > (1u << 31))
+        _options._maxFragmentBytes = 1u << 31;
+    _video._id = 1;
+    _audio._id = 2;
+}
+
+FMP4Remuxer::~FMP4Remuxer()
+{
+    if (_fd >= 0)
+        close(_fd);
+}
+
+RemuxResult FMP4Remuxer::Result() const
+{
+    RemuxResult result = _result;
+    result._bytes = _writer.Tell();
+    result._writeCalls = _writer.WriteCalls();
+    return result;
+}
+
+bool FMP4Remuxer::Fill(uint64_t end)
+{
+    if (end <= _windowEnd)
+        return true;
+    size_t needed = (size_t)(end - _windowStart);
+    if (needed > _windowCapacity)
+    {
+        if (needed > _options._maxFragmentBytes)
+            return false;
+        size_t capacity = _windowCapacity ? _windowCapacity : kWindowInitial;
+        while (capacity < needed)
+            capacity *= 2;
+        if (capacity > _options._maxFragmentBytes)
+            capacity = _options._maxFragmentBytes;
+        std::unique_ptr<uint8_t[]> window(new uint8_t[capacity]);
+        if (_windowEnd > _windowStart)
+            memcpy(window.get(), _window.get(), (size_t)(_windowEnd - _windowStart));
+        _window.swap(window);
+        _windowCapacity = capacity;
+    }
+    // read ahead as far as the window allows
+    while (_windowEnd < end)
+    {
+        size_t used = (size_t)(_windowEnd - _windowStart);
+        ssize_t got = pread(_fd, _window.get() + used, _windowCapacity - used, (off_t)_windowEnd);
+        if (got < 0 && errno == EINTR)
+            continue;
+        if (got <= 0)
+            return false;
+        _windowEnd += got;
+    }
+    return true;
+}
+
+void FMP4Remuxer::Compact(uint64_t offset)
+{
+    if (offset >= _windowEnd)
+    {
+        _windowStart = _windowEnd = offset;
+        return;
+    }
+    memmove(_window.get(), _window.get() + (offset - _windowStart), (size_t)(_windowEnd - offset));
+    _windowStart = offset;
+}
+
+bool FMP4Remuxer::Configure(Track& track, const uint8_t* config, size_t size)
+{
+    if (track._bEnabled && track._config.size() == size && memcmp(track._config.data(), config, size) == 0)
+    {
+        _result._droppedTags++;
+        return true;
+    }
+    if (track._bEnabled)
+    {
+        std::cerr << "[failed]: the " << (track._id == _video._id ? "AVC" : "AAC") <<
+            " configuration changes mid stream, fragmented mp4 needs a new init segment" << std::endl;
+        return false;
+    }
+    if (_bInitWritten)
+    {
+        std::cerr << "[warning]: the " << (track._id == _video._id ? "video" : "audio") <<
+            " configuration comes after the init segment, the track is dropped" << std::endl;
+        _result._droppedTags++;
+        return true;
+    }
+    if (&track == &_video)
+    {
+        if (!ParseAVCDimensions(config, size, _result._width, _result._height))
+            std::cerr << "[warning]: the SPS could not be parsed, the video size is left 0" << std::endl;
+    }
+    else
+    {
+        if (!ParseAudioSpecificConfig(config, size, _result._sampleRate, _result._channels))
+        {
+            std::cerr << "[failed]: the AudioSpecificConfig is not right" << std::endl;
+            return false;
+        }
+        track._timescale = _result._sampleRate;
+    }
+    track._config.assign(config, config + size);
+    track._bEnabled = true;
+    return true;
+}
+
+bool FMP4Remuxer::WriteInit()
+{
+    _bInitWritten = true;
+    _boxes.clear();
+    BoxBuffer box(_boxes);
+    size_t ftyp = box.Begin("ftyp");
+    box.Bytes("iso5", 4);
+    box.U32(512);
+    box.Bytes("iso5iso6mp41", 12);
+    box.End(ftyp);
+
+    size_t moov = box.Begin("moov");
+    size_t mvhd = box.BeginFull("mvhd", 0, 0);
+    box.U32(0);                                 // creation_time
+    box.U32(0);                                 // modification_time
+    box.U32(1000);
+    box.U32(0);                                 // duration, unknown when fragmented
+    box.U32(0x00010000);                        // rate 1.0
+    box.U16(0x0100);                            // volume 1.0
+    box.Zeros(10);
+    box.Matrix();
+    box.Zeros(24);                              // pre_defined
+    box.U32(3);                                 // next_track_ID
+    box.End(mvhd);
+
+    Track* tracks[] = { &_video, &_audio };
+    for (int idx = 0; idx < 2; idx++)
+    {
+        Track& track = *tracks[idx];
+        if (!track._bEnabled)
+            continue;
+        bool bVideo = &track == &_video;
+        size_t trak = box.Begin("trak");
+        size_t tkhd = box.BeginFull("tkhd", 0, 0x000003);
+        box.U32(0);
+        box.U32(0);
+        box.U32(track._id);
+        box.U32(0);
+        box.U32(0);                             // duration
+        box.Zeros(8);
+        box.U16(0);                             // layer
+        box.U16(0);                             // alternate_group
+        box.U16(bVideo ? 0 : 0x0100);           // volume
+        box.U16(0);
+        box.Matrix();
+        box.U32(bVideo ? _result._width << 16 : 0);
+        box.U32(bVideo ? _result._height << 16 : 0);
+        box.End(tkhd);
+
+        size_t mdia = box.Begin("mdia");
+        size_t mdhd = box.BeginFull("mdhd", 0, 0);
+        box.U32(0);
+        box.U32(0);
+        box.U32(track._timescale);
+        box.U32(0);
+        box.U16(0x55C4);                        // "und"
+        box.U16(0);
+        box.End(mdhd);
+        size_t hdlr = box.BeginFull("hdlr", 0, 0);
+        box.U32(0);
+        box.Bytes(bVideo ? "vide" : "soun", 4);
+        box.Zeros(12);
+        const char* name = bVideo ? "VideoHandler" : "SoundHandler";
+        box.Bytes(name, strlen(name) + 1);
+        box.End(hdlr);
+
+        size_t minf = box.Begin("minf");
+        if (bVideo)
+        {
+            size_t vmhd = box.BeginFull("vmhd", 0, 1);
+            box.Zeros(8);                       // graphicsmode, opcolor
+            box.End(vmhd);
+        }
+        else
+        {
+            size_t smhd = box.BeginFull("smhd", 0, 0);
+            box.Zeros(4);                       // balance, reserved
+            box.End(smhd);
+        }
+        size_t dinf = box.Begin("dinf");
+        size_t dref = box.BeginFull("dref", 0, 0);
+        box.U32(1);
+        size_t url = box.BeginFull("url ", 0, 1);   // media in the same file
+        box.End(url);
+        box.End(dref);
+        box.End(dinf);
+
+        size_t stbl = box.Begin("stbl");
+        size_t stsd = box.BeginFull("stsd", 0, 0);
+        box.U32(1);
+        if (bVideo)
+        {
+            size_t avc1 = box.Begin("avc1");
+            box.Zeros(6);
+            box.U16(1);                         // data_reference_index
+            box.Zeros(16);
+            box.U16(_result._width);
+            box.U16(_result._height);
+            box.U32(0x00480000);                // 72 dpi
+            box.U32(0x00480000);
+            box.U32(0);
+            box.U16(1);                         // frame_count
+            box.Zeros(32);                      // compressorname
+            box.U16(0x0018);                    // depth
+            box.U16(0xFFFF);                    // pre_defined = -1
+            size_t avcC = box.Begin("avcC");
+            box.Bytes(track._config.data(), track._config.size());
+            box.End(avcC);
+            box.End(avc1);
+        }
+        else
+        {
+            size_t mp4a = box.Begin("mp4a");
+            box.Zeros(6);
+            box.U16(1);
+            box.Zeros(8);
+            box.U16(_result._channels ? _result._channels : 2);
+            box.U16(16);                        // samplesize
+            box.Zeros(4);
+            box.U32((_result._sampleRate & 0xFFFF) << 16);
+            size_t esds = box.BeginFull("esds", 0, 0);
+            uint32_t config = (uint32_t)track._config.size();
+            box.Descriptor(0x03, 3 + 5 + 13 + 5 + config + 5 + 1);     // ES_Descriptor
+            box.U16(track._id);
+            box.U8(0);
+            box.Descriptor(0x04, 13 + 5 + config);                      // DecoderConfigDescriptor
+            box.U8(0x40);                       // MPEG-4 audio
+            box.U8(0x15);                       // audio stream
+            box.U24(0);                         // bufferSizeDB
+            box.U32(0);                         // maxBitrate
+            box.U32(0);                         // avgBitrate
+            box.Descriptor(0x05, config);                               // DecoderSpecificInfo
+            box.Bytes(track._config.data(), config);
+            box.Descriptor(0x06, 1);                                    // SLConfigDescriptor
+            box.U8(0x02);
+            box.End(esds);
+            box.End(mp4a);
+        }
+        box.End(stsd);
+        // empty sample tables, the samples live in the fragments
+        const char* tables[] = { "stts", "stsc", "stco" };
+        for (int table = 0; table < 3; table++)
+        {
+            size_t at = box.BeginFull(tables[table], 0, 0);
+            box.U32(0);
+            box.End(at);
+        }
+        size_t stsz = box.BeginFull("stsz", 0, 0);
+        box.U32(0);
+        box.U32(0);
+        box.End(stsz);
+        box.End(stbl);
+        box.End(minf);
+        box.End(mdia);
+        box.End(trak);
+    }
+
+    size_t mvex = box.Begin("mvex");
+    for (int idx = 0; idx < 2; idx++)
+    {
+        if (!tracks[idx]->_bEnabled)
+            continue;
+        size_t trex = box.BeginFull("trex", 0, 0);
+        box.U32(tracks[idx]->_id);
+        box.U32(1);                             // default_sample_description_index
+        box.Zeros(12);
+        box.End(trex);
+    }
+    box.End(mvex);
+    box.End(moov);
+    return _writer.Write(_boxes.data(), _boxes.size());
+}
+
+uint64_t FMP4Remuxer::DecodeTime(const Track& track) const
+{
+    uint64_t decodeTime = (uint64_t)track._samples[0]._dts * track._timescale / 1000;
+    if (&track == &_video)
+        return decodeTime;
+    // AAC frames are counted so millisecond rounding of the timestamps does
+    // not leave holes, a real gap of a frame or more is kept
+    if (track._bStarted)
+    {
+        uint64_t distance = decodeTime > track._nextDecodeTime ? decodeTime - track._nextDecodeTime :
+                                                                  track._nextDecodeTime - decodeTime;
+        if (distance <= kAACFrameSamples)
+            return track._nextDecodeTime;
+    }
+    return decodeTime;
+}
+
+bool FMP4Remuxer::WriteFragment(bool bNext, uint32_t nextVideoDts)
+{
+    if (_video._samples.empty() && _audio._samples.empty())
+        return true;
+    if (!_bInitWritten && !WriteInit())
+        return false;
+    _boxes.clear();
+    BoxBuffer box(_boxes);
+    size_t moof = box.Begin("moof");
+    size_t mfhd = box.BeginFull("mfhd", 0, 0);
+    box.U32(++_sequence);
+    box.End(mfhd);
+
+    Track* tracks[] = { &_video, &_audio };
+    size_t dataOffsets[2] = { 0, 0 };
+    for (int idx = 0; idx < 2; idx++)
+    {
+        Track& track = *tracks[idx];
+        if (track._samples.empty())
+            continue;
+        bool bVideo = &track == &_video;
+        size_t traf = box.Begin("traf");
+        size_t tfhd = box.BeginFull("tfhd", 0, 0x020000);  // default-base-is-moof
+        box.U32(track._id);
+        box.End(tfhd);
+        size_t tfdt = box.BeginFull("tfdt", 1, 0);
+        track._nextDecodeTime = DecodeTime(track);
+        track._bStarted = true;
+        box.U64(track._nextDecodeTime);
+        box.End(tfdt);
+
+        // data offset, duration, size, flags and composition offset per sample
+        size_t trun = box.BeginFull("trun", bVideo ? 1 : 0, bVideo ? 0x000F01 : 0x000701);
+        size_t count = track._samples.size();
+        box.U32((uint32_t)count);
+        dataOffsets[idx] = box.Size();
+        box.U32(0);
+        for (size_t sample = 0; sample < count; sample++)
+        {
+            const Sample& current = track._samples[sample];
+            uint32_t duration = kAACFrameSamples;
+            if (bVideo)
+            {
+                if (sample + 1 < count)
+                    duration = track._samples[sample + 1]._dts - current._dts;
+                else if (bNext && nextVideoDts >= current._dts)
+                    duration = nextVideoDts - current._dts;
+                else
+                    duration = track._lastDuration;
+                // timestamps going back in time give an empty sample
+                if (duration > 0x7FFFFFFF)
+                    duration = 0;
+                if (duration)
+                    track._lastDuration = duration;
+            }
+            track._nextDecodeTime += bVideo ? duration : kAACFrameSamples;
+            box.U32(duration);
+            box.U32(current._size);
+            box.U32(current._bKeyframe ? kSampleSync : kSampleNonSync);
+            if (bVideo)
+                box.U32((uint32_t)current._cts);
+        }
+        box.End(trun);
+        box.End(traf);
+    }
+    box.End(moof);
+
+    uint64_t payload = 0;
+    for (int idx = 0; idx < 2; idx++)
+    {
+        if (tracks[idx]->_samples.empty())
+            continue;
+        box.Patch(dataOffsets[idx], (uint32_t)(box.Size() + 8 + payload));
+        for (const Sample& sample : tracks[idx]->_samples)
+            payload += sample._size;
+    }
+    size_t mdat = box.Begin("mdat");
+    box.Patch(mdat, (uint32_t)(8 + payload));
+
+    // the moof and every sample straight from the read window
+    _iov.clear();
+    _iov.push_back(iovec{ _boxes.data(), _boxes.size() });
+    for (int idx = 0; idx < 2; idx++)
+    {
+        for (const Sample& sample : tracks[idx]->_samples)
+            _iov.push_back(iovec{ _window.get() + (sample._offset - _windowStart), sample._size });
+    }
+    if (!_writer.WriteVector(_iov.data(), (int)_iov.size()))
+        return false;
+    _result._fragments++;
+    _result._videoSamples += _video._samples.size();
+    _result._audioSamples += _audio._samples.size();
+    _video._samples.clear();
+    _audio._samples.clear();
+    return true;
+}
+
+bool FMP4Remuxer::Remux(const char* inputFile)
+{
+    if (_bRemuxed)
+    {
+        std::cerr << "[failed]: the remuxer takes a single input" << std::endl;
+        return false;
+    }
+    _bRemuxed = true;
+    _fd = open(inputFile, O_RDONLY | O_CLOEXEC);
+    if (_fd < 0)
+    {
+        std::cerr << "[failed]: could not open the " << inputFile << std::endl;
+        return false;
+    }
+    struct stat st;
+    if (fstat(_fd, &st) == 0)
+        _fileSize = st.st_size;
+#ifdef POSIX_FADV_SEQUENTIAL
+    posix_fadvise(_fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+
+    if (!Fill(sizeof(FLVHeader)))
+    {
+        std::cerr << "[failed]: " << inputFile << " is too short for a flv header" << std::endl;
+        return false;
+    }
+    const uint8_t* header = _window.get();
+    if (header[0] != 'F' || header[1] != 'L' || header[2] != 'V')
+    {
+        std::cerr << "[failed]: " << inputFile << " flv header signature is not right" << std::endl;
+        return false;
+    }
+    uint32_t dataOffset = ((uint32_t)header[5] << 24) | (header[6] << 16) | (header[7] << 8) | header[8];
+    // skip the header and PreviousTagSize0
+    uint64_t position = (uint64_t)dataOffset + sizeof(uint32_t);
+    if (dataOffset < sizeof(FLVHeader) || position > _fileSize)
+    {
+        std::cerr << "[failed]: " << inputFile << " flv header data offset is not right" << std::endl;
+        return false;
+    }
+    Compact(position);
+
+    while (position < _fileSize)
+    {
+        if (!Fill(position + sizeof(FLVTag::FLVTagHeader)))
+        {
+            std::cerr << "[warning]: " << inputFile << " ends inside a tag header" << std::endl;
+            break;
+        }
+        FLVTag::FLVTagHeader tag;
+        memcpy(&tag, _window.get() + (position - _windowStart), sizeof(tag));
+        uint32_t dataSize = TagDataSize(tag);
+        uint64_t end = position + sizeof(tag) + dataSize + sizeof(uint32_t);
+        if (end > _fileSize)
+        {
+            std::cerr << "[warning]: " << inputFile << " ends inside a tag, the partial tag is dropped" << std::endl;
+            break;
+        }
+        if (!Fill(end))
+        {
+            // the window is full: the pending samples go out first
+            if (!WriteFragment(false, 0))
+                return false;
+            Compact(position);
+            if (!Fill(end))
+            {
+                std::cerr << "[failed]: the tag at offset " << position << " does not fit the " <<
+                    _options._maxFragmentBytes << " bytes read window" << std::endl;
+                return false;
+            }
+        }
+        const uint8_t* data = _window.get() + (position + sizeof(tag) - _windowStart);
+        uint32_t timestamp = TagTimestamp(tag);
+        uint64_t payload = position + sizeof(tag);
+        position = end;
+
+        Track* track = nullptr;
+        bool bKeyframe = true;
+        int32_t cts = 0;
+        uint32_t mediaHeader = 0;
+        // enhanced tags (IsExHeader set) are not AVC whatever their low nibble says
+        if (tag._tagType == TagTypeVideo && dataSize >= 5 && !(data[0] & 0x80) && (data[0] & 0x0F) == AVC)
+        {
+            if (data[1] == AVCSequenceHeader)
+            {
+                if (!Configure(_video, data + 5, dataSize - 5))
+                    return false;
+                continue;
+            }
+            if (data[1] == AVCNALU && _video._bEnabled)
+            {
+                track = &_video;
+                mediaHeader = 5;
+                bKeyframe = (data[0] >> 4) == KeyFrame;
+                // SI24 composition time
+                cts = (int32_t)(((uint32_t)data[2] << 24) | (data[3] << 16) | (data[4] << 8)) >> 8;
+            }
+        }
+        else if (tag._tagType == TagTypeAudio && dataSize >= 2 && (data[0] >> 4) == AAC)
+        {
+            if (data[1] == AACSequenceHeader)
+            {
+                if (!Configure(_audio, data + 2, dataSize - 2))
+                    return false;
+                continue;
+            }
+            if (_audio._bEnabled)
+            {
+                track = &_audio;
+                mediaHeader = 2;
+            }
+        }
+        if (!track)
+        {
+            _result._droppedTags++;
+            continue;
+        }
+
+        bool bPending = !_video._samples.empty() || !_audio._samples.empty();
+        bool bCut = false;
+        if (bPending && timestamp >= _fragmentStart)
+        {
+            uint32_t elapsed = timestamp - _fragmentStart;
+            if (_video._bEnabled)
+                bCut = track == &_video && bKeyframe && elapsed >= _options._fragmentMs;
+            else
+                bCut = elapsed >= (_options._fragmentMs ? _options._fragmentMs : kAudioOnlyFragmentMs);
+        }
+        if (bCut)
+        {
+            if (!WriteFragment(true, timestamp))
+                return false;
+            Compact(payload - sizeof(tag));
+            bPending = false;
+        }
+        if (!bPending)
+            _fragmentStart = timestamp;
+        track->_samples.push_back(Sample{ payload + mediaHeader, dataSize - mediaHeader, timestamp, cts, bKeyframe });
+    }
+    if (!_video._bEnabled && !_audio._bEnabled)
+    {
+        std::cerr << "[failed]: " << inputFile << " has no AVC or AAC track to remux" << std::endl;
+        return false;
+    }
+    if (!WriteFragment(false, 0) || (!_bInitWritten && !WriteInit()))
+        return false;
+    return _writer.Flush();
+}
+
+FLVPARSER_NAMESPACE_END
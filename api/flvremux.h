@@ -0,0 +1,122 @@
+/**
+* This file is part of FLVParser.
+
+* FLVParser is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+
+* FLVParser is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+
+* You should have received a copy of the GNU General Public License
+* along with FLVParser.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef FLVREMUX_H_
+#define FLVREMUX_H_
+
+#include "common.h"
+#include "flvparser.h"
+#include "flvwriter.h"
+
+#include <memory>
+#include <vector>
+
+FLVPARSER_NAMESPACE_BEGIN
+
+struct RemuxOptions
+{
+    uint32_t        _fragmentMs         { 0 };          //!< Shortest fragment, 0 cuts at every video keyframe
+    size_t          _maxFragmentBytes   { 64 << 20 };   //!< Read window, a larger fragment is cut early
+};
+
+struct RemuxResult
+{
+    uint32_t        _fragments          { 0 };
+    uint64_t        _videoSamples       { 0 };
+    uint64_t        _audioSamples       { 0 };
+    uint64_t        _droppedTags        { 0 };      //!< Script data, other codecs, repeated configurations
+    uint64_t        _bytes              { 0 };
+    uint64_t        _writeCalls         { 0 };
+    uint32_t        _width              { 0 };      //!< From the SPS
+    uint32_t        _height             { 0 };
+    uint32_t        _sampleRate         { 0 };      //!< From the AudioSpecificConfig
+    uint8_t         _channels           { 0 };
+};
+
+// FLV to fragmented MP4 (ISO BMFF) remuxer for AVC video and AAC audio.
+// The init segment (ftyp + moov) is built from the sequence headers, then
+// every GOP, or every _fragmentMs starting at a keyframe, becomes one
+// moof + mdat. The input is read in large blocks into a window holding the
+// current fragment and the samples are written from that window with one
+// gathered write, frame data is never copied in user space.
+class FMP4Remuxer
+{
+public:
+    explicit FMP4Remuxer(const char* outputFile, const RemuxOptions& options = RemuxOptions());
+    ~FMP4Remuxer();
+
+    FMP4Remuxer(const FMP4Remuxer&)             = delete;
+    FMP4Remuxer& operator= (const FMP4Remuxer&) = delete;
+
+    //! Remuxes one whole input file, a remuxer takes a single input. The
+    //! file is read through its own pread window, so it has to be a regular
+    //! file; fails when it holds neither an AVC nor an AAC track
+    bool                Remux(const char* inputFile);
+    RemuxResult         Result() const;
+
+private:
+    struct Sample
+    {
+        uint64_t        _offset;                //!< In the input file
+        uint32_t        _size;
+        uint32_t        _dts;                   //!< Milliseconds
+        int32_t         _cts;                   //!< Composition offset, milliseconds
+        bool            _bKeyframe;
+    };
+
+    struct Track
+    {
+        uint32_t        _id;
+        std::vector<uint8_t> _config;           //!< AVCDecoderConfigurationRecord / AudioSpecificConfig
+        bool            _bEnabled       { false };
+        uint32_t        _timescale      { 1000 };
+        uint32_t        _lastDuration   { 0 };  //!< Milliseconds, used for the last sample of a fragment
+        uint64_t        _nextDecodeTime { 0 };  //!< Timescale units after the last written sample
+        bool            _bStarted       { false };
+        std::vector<Sample> _samples;           //!< Of the pending fragment
+    };
+
+    bool                Fill(uint64_t end);
+    void                Compact(uint64_t offset);
+    bool                Configure(Track& track, const uint8_t* config, size_t size);
+    bool                WriteInit();
+    //! nextVideoDts is the dts following the fragment when bNext is set
+    bool                WriteFragment(bool bNext, uint32_t nextVideoDts);
+    uint64_t            DecodeTime(const Track& track) const;
+
+    FLVWriter           _writer;
+    RemuxOptions        _options;
+    int                 _fd             { -1 };
+    uint64_t            _fileSize       { 0 };
+    std::unique_ptr<uint8_t[]> _window;
+    size_t              _windowCapacity { 0 };
+    uint64_t            _windowStart    { 0 };  //!< File offset of _window[0]
+    uint64_t            _windowEnd      { 0 };  //!< File offset after the last byte read
+    Track               _video;
+    Track               _audio;
+    uint32_t            _fragmentStart  { 0 };  //!< Dts of the first pending sample
+    uint32_t            _sequence       { 0 };
+    bool                _bInitWritten   { false };
+    bool                _bRemuxed       { false };
+    std::vector<uint8_t> _boxes;                //!< moof and mdat header of the fragment being written
+    std::vector<iovec>  _iov;
+    RemuxResult         _result;
+};
+
+FLVPARSER_NAMESPACE_END
+
+#endif // FLVREMUX_H_
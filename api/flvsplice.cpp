@@ -0,0 +1,333 @@
+/**
+* This file is part of FLVParser.
+
+* FLVParser is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+
+* FLVParser is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+
+* You should have received a copy of the GNU General Public License
+* along with FLVParser.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "common.h"
+#include "flvsplice.h"
+#include "flvamf0.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+FLVPARSER_NAMESPACE_BEGIN
+
+static const uint8_t kOnMetaData[13] = { STRING, 0, 10, 'o', 'n', 'M', 'e', 't', 'a', 'D', 'a', 't', 'a' };
+
+// Read window over one input segment
+struct FLVSplicer::Segment
+{
+    int                 _fd         { -1 };
+    uint64_t            _fileSize   { 0 };
+    uint8_t*            _buffer     { nullptr };
+    size_t              _capacity   { 0 };
+    uint64_t            _position   { 0 };      //!< File offset of _buffer[0]
+    size_t              _begin      { 0 };
+    size_t              _end        { 0 };
+
+    ~Segment()
+    {
+        if (_fd >= 0)
+            close(_fd);
+    }
+
+    uint64_t            Offset() const      { return _position + _begin; }
+    size_t              Available() const   { return _end - _begin; }
+    const uint8_t*      Data() const        { return _buffer + _begin; }
+    void                Consume(size_t size) { _begin += size; }
+
+    //! Makes size bytes available at Data(), false when the file ends first
+    bool Fill(size_t size)
+    {
+        if (Available() >= size)
+            return true;
+        if (size > _capacity)
+            return false;
+        memmove(_buffer, _buffer + _begin, Available());
+        _position += _begin;
+        _end -= _begin;
+        _begin = 0;
+        while (_end < size)
+        {
+            ssize_t got = pread(_fd, _buffer + _end, _capacity - _end, (off_t)(_position + _end));
+            if (got < 0 && errno == EINTR)
+                continue;
+            if (got <= 0)
+                return false;
+            _end += got;
+        }
+        return true;
+    }
+
+    void SkipTo(uint64_t offset)
+    {
+        _position = offset;
+        _begin = _end = 0;
+    }
+};
+
+FLVSplicer::FLVSplicer(const char* outputFile, const SpliceOptions& options)
+                : _writer(outputFile),
+                  _options(options)
+{
+    if (_options._readBufferSize < (1 << 16))
+        _options._readBufferSize = 1 << 16;
+    // a tag below the threshold must fit the read window
+    if (_options._copyThreshold > _options._readBufferSize / 2)
+        _options._copyThreshold = _options._readBufferSize / 2;
+    _readBuffer.reset(new uint8_t[_options._readBufferSize]);
+}
+
+FLVSplicer::~FLVSplicer()
+{
+    if (!_bFinished)
+        Finish();
+}
+
+SpliceResult FLVSplicer::Result() const
+{
+    SpliceResult result = _result;
+    result._bytes = _writer.Tell();
+    result._kernelCopiedBytes = _writer.KernelCopiedBytes();
+    result._durationMs = NextStart();
+    return result;
+}
+
+uint32_t FLVSplicer::NextStart() const
+{
+    uint32_t next = 0;
+    const Track* tracks[] = { &_video, &_audio };
+    for (int idx = 0; idx < 2; idx++)
+    {
+        if (tracks[idx]->_bSeen && tracks[idx]->_lastTimestamp + tracks[idx]->_lastDelta > next)
+            next = tracks[idx]->_lastTimestamp + tracks[idx]->_lastDelta;
+    }
+    return next;
+}
+
+uint32_t FLVSplicer::Rebase(uint32_t timestamp)
+{
+    int64_t rebased = (int64_t)timestamp + _offset;
+    // a track starting a little before the first tag must not go back in time
+    if (rebased < (int64_t)_start)
+        rebased = _start;
+    return (uint32_t)rebased;
+}
+
+bool FLVSplicer::IsDuplicateHeader(Track& track, const uint8_t* data, uint32_t dataSize)
+{
+    if (track._config.size() == dataSize && memcmp(track._config.data(), data, dataSize) == 0)
+        return true;
+    track._config.assign(data, data + dataSize);
+    return false;
+}
+
+bool FLVSplicer::CopyTag(Segment& segment, const FLVTag::FLVTagHeader& header, uint32_t dataSize)
+{
+    if (!_writer.Write(&header, sizeof(header)))
+        return false;
+    uint64_t body = (uint64_t)dataSize + sizeof(uint32_t);
+    if (body < _options._copyThreshold || segment.Available() >= body)
+    {
+        if (!segment.Fill(body) || !_writer.Write(segment.Data(), body))
+            return false;
+        segment.Consume(body);
+        return true;
+    }
+    // large payloads go file to file, only the part already read is written
+    size_t buffered = segment.Available();
+    if (buffered && !_writer.Write(segment.Data(), buffered))
+        return false;
+    uint64_t offset = segment.Offset() + buffered;
+    if (!_writer.CopyFrom(segment._fd, offset, body - buffered))
+        return false;
+    segment.SkipTo(offset + body - buffered);
+    return true;
+}
+
+bool FLVSplicer::Append(const char* inputFile)
+{
+    if (_bFinished)
+    {
+        std::cerr << "[failed]: the splice output is already finished" << std::endl;
+        return false;
+    }
+    Segment segment;
+    segment._fd = open(inputFile, O_RDONLY | O_CLOEXEC);
+    if (segment._fd < 0)
+    {
+        std::cerr << "[failed]: could not open the " << inputFile << std::endl;
+        return false;
+    }
+    struct stat st;
+    if (fstat(segment._fd, &st) == 0)
+        segment._fileSize = st.st_size;
+#ifdef POSIX_FADV_SEQUENTIAL
+    posix_fadvise(segment._fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+    segment._buffer = _readBuffer.get();
+    segment._capacity = _options._readBufferSize;
+
+    if (!segment.Fill(sizeof(FLVHeader)))
+    {
+        std::cerr << "[failed]: " << inputFile << " is too short for a flv header" << std::endl;
+        return false;
+    }
+    const uint8_t* header = segment.Data();
+    if (header[0] != 'F' || header[1] != 'L' || header[2] != 'V')
+    {
+        std::cerr << "[failed]: " << inputFile << " flv header signature is not right" << std::endl;
+        return false;
+    }
+    _typeFlags |= header[4] & 0x05;
+    uint32_t dataOffset = ((uint32_t)header[5] << 24) | (header[6] << 16) | (header[7] << 8) | header[8];
+    if (!_bHeaderWritten)
+    {
+        if (!_writer.WriteHeader(!!(header[4] & 0x04), !!(header[4] & 0x01)))
+            return false;
+        _bHeaderWritten = true;
+    }
+    // skip the header and PreviousTagSize0
+    segment.SkipTo((uint64_t)dataOffset + sizeof(uint32_t));
+    _bSegmentStarted = false;
+    _result._segments++;
+
+    while (segment.Offset() < segment._fileSize)
+    {
+        if (!segment.Fill(sizeof(FLVTag::FLVTagHeader)))
+        {
+            std::cerr << "[warning]: " << inputFile << " ends inside a tag header" << std::endl;
+            break;
+        }
+        FLVTag::FLVTagHeader tag;
+        memcpy(&tag, segment.Data(), sizeof(tag));
+        uint32_t dataSize = TagDataSize(tag);
+        if (segment.Offset() + sizeof(tag) + dataSize + sizeof(uint32_t) > segment._fileSize)
+        {
+            std::cerr << "[warning]: " << inputFile << " ends inside a tag, the partial tag is dropped" << std::endl;
+            break;
+        }
+        if (tag._tagType != TagTypeAudio && tag._tagType != TagTypeVideo &&
+            tag._tagType != TagTypeScript)
+        {
+            std::cerr << "[failed]: " << inputFile << " unknown flv tag type at offset " <<
+                segment.Offset() << std::endl;
+            return false;
+        }
+        uint32_t timestamp = TagTimestamp(tag);
+        if (!_bSegmentStarted)
+        {
+            _bSegmentStarted = true;
+            _start = NextStart();
+            _offset = _result._segments == 1 ? 0 : (int64_t)_start - timestamp;
+        }
+
+        // small tags are looked at as a whole, the read window fits them
+        size_t whole = sizeof(tag) + dataSize;
+        bool bInWindow = whole <= _options._copyThreshold && segment.Fill(whole);
+        const uint8_t* data = segment.Data() + sizeof(tag);
+        bool bDrop = false;
+        bool bMetadata = false;
+        Track* track = nullptr;
+        if (tag._tagType == TagTypeScript)
+        {
+            bMetadata = bInWindow && dataSize >= sizeof(kOnMetaData) &&
+                        memcmp(data, kOnMetaData, sizeof(kOnMetaData)) == 0;
+            if (bMetadata && _options._bMergeMetadata && _metadataOffset)
+            {
+                bDrop = true;
+                _result._droppedMetadata++;
+            }
+        }
+        else
+        {
+            track = tag._tagType == TagTypeVideo ? &_video : &_audio;
+            bool bConfig = false;
+            if (bInWindow && tag._tagType == TagTypeVideo)
+            {
+                VideoHeaderInfo video;
+                bConfig = ParseVideoHeader(data, dataSize, video) && video._bSequenceHeader;
+            }
+            else if (bInWindow && dataSize >= 2)
+            {
+                bConfig = (data[0] >> 4) == AAC && data[1] == AACSequenceHeader;
+            }
+            if (bConfig && IsDuplicateHeader(*track, data, dataSize) && _options._bDropDuplicateHeaders)
+            {
+                bDrop = true;
+                _result._droppedHeaders++;
+            }
+        }
+        if (bDrop)
+        {
+            if (segment.Available() >= whole + sizeof(uint32_t))
+                segment.Consume(whole + sizeof(uint32_t));
+            else
+                segment.SkipTo(segment.Offset() + whole + sizeof(uint32_t));
+            continue;
+        }
+
+        uint32_t rebased = Rebase(timestamp);
+        SetTagTimestamp(tag, rebased);
+        if (track)
+        {
+            if (track->_bSeen && rebased > track->_lastTimestamp)
+                track->_lastDelta = rebased - track->_lastTimestamp;
+            track->_bSeen = true;
+            track->_lastTimestamp = rebased;
+        }
+        if (bMetadata && !_metadataOffset)
+        {
+            _metadataOffset = _writer.Tell() + sizeof(tag);
+            size_t offset;
+            if (FindMetadataNumber(data, dataSize, "duration", offset))
+                _durationOffset = _metadataOffset + offset;
+            if (FindMetadataNumber(data, dataSize, "filesize", offset))
+                _fileSizeOffset = _metadataOffset + offset;
+        }
+        segment.Consume(sizeof(tag));
+        if (!CopyTag(segment, tag, dataSize))
+            return false;
+        _result._tags++;
+    }
+    return true;
+}
+
+bool FLVSplicer::Finish()
+{
+    if (_bFinished)
+        return true;
+    _bFinished = true;
+    if (!_bHeaderWritten && !_writer.WriteHeader(false, false))
+        return false;
+    bool bOk = _writer.Patch(4, &_typeFlags, 1);
+    uint8_t number[8];
+    if (_options._bMergeMetadata && _durationOffset)
+    {
+        WriteAmf0Double(number, NextStart() / 1000.0);
+        bOk = _writer.Patch(_durationOffset, number, sizeof(number)) && bOk;
+    }
+    if (_options._bMergeMetadata && _fileSizeOffset)
+    {
+        WriteAmf0Double(number, (double)_writer.Tell());
+        bOk = _writer.Patch(_fileSizeOffset, number, sizeof(number)) && bOk;
+    }
+    return _writer.Flush() && bOk;
+}
+
+FLVPARSER_NAMESPACE_END
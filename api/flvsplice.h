@@ -0,0 +1,97 @@
+/**
+* This file is part of FLVParser.
+
+* FLVParser is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+
+* FLVParser is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+
+* You should have received a copy of the GNU General Public License
+* along with FLVParser.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef FLVSPLICE_H_
+#define FLVSPLICE_H_
+
+#include "common.h"
+#include "flvwriter.h"
+
+#include <memory>
+#include <vector>
+
+FLVPARSER_NAMESPACE_BEGIN
+
+struct SpliceOptions
+{
+    bool            _bDropDuplicateHeaders  { true };       //!< Skip AVC/AAC configs equal to the current one
+    bool            _bMergeMetadata         { true };       //!< Keep the first onMetaData, patch duration/filesize
+    uint32_t        _copyThreshold          { 256 << 10 };  //!< Tags from this size on are copied in the kernel
+    uint32_t        _readBufferSize         { 1 << 20 };
+};
+
+struct SpliceResult
+{
+    uint32_t        _segments               { 0 };
+    uint64_t        _tags                   { 0 };          //!< Tags written
+    uint64_t        _droppedHeaders         { 0 };
+    uint64_t        _droppedMetadata        { 0 };
+    uint64_t        _bytes                  { 0 };          //!< Output size
+    uint64_t        _kernelCopiedBytes      { 0 };          //!< Part of _bytes copied by copy_file_range
+    uint32_t        _durationMs             { 0 };
+};
+
+// Joins FLV segments into one file. Every segment after the first is
+// shifted so it starts one frame after the end of the previous one, the
+// tags themselves are copied unchanged apart from their timestamp. The
+// keyframes index of the first onMetaData, if any, is not rebuilt.
+class FLVSplicer
+{
+public:
+    FLVSplicer(const char* outputFile, const SpliceOptions& options = SpliceOptions());
+    ~FLVSplicer();
+
+    bool                Append(const char* inputFile);
+    //! Patches the header flags and onMetaData, then flushes the output
+    bool                Finish();
+    SpliceResult        Result() const;
+
+private:
+    struct Segment;
+    struct Track
+    {
+        bool                    _bSeen          { false };
+        uint32_t                _lastTimestamp  { 0 };  //!< In the output
+        uint32_t                _lastDelta      { 0 };  //!< Last positive timestamp step
+        std::vector<uint8_t>    _config;                //!< Current AVC/AAC sequence header payload
+    };
+
+    bool                CopyTag(Segment& segment, const FLVTag::FLVTagHeader& header, uint32_t dataSize);
+    bool                IsDuplicateHeader(Track& track, const uint8_t* data, uint32_t dataSize);
+    uint32_t            Rebase(uint32_t timestamp);
+    uint32_t            NextStart() const;
+
+    FLVWriter           _writer;
+    SpliceOptions       _options;
+    SpliceResult        _result;
+    std::unique_ptr<uint8_t[]> _readBuffer;
+    Track               _video;
+    Track               _audio;
+    bool                _bHeaderWritten     { false };
+    bool                _bFinished          { false };
+    uint8_t             _typeFlags          { 0 };
+    int64_t             _offset             { 0 };      //!< Added to the timestamps of the current segment
+    bool                _bSegmentStarted    { false };
+    uint32_t            _start              { 0 };      //!< Output timestamp the current segment starts at
+    uint64_t            _metadataOffset     { 0 };      //!< Where the kept onMetaData payload starts
+    uint64_t            _durationOffset     { 0 };      //!< Output offsets of the numbers to patch, 0 if absent
+    uint64_t            _fileSizeOffset     { 0 };
+};
+
+FLVPARSER_NAMESPACE_END
+
+#endif // FLVSPLICE_H_
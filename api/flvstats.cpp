@@ -0,0 +1,324 @@
+/**
+* This file is part of FLVParser.
+
+* FLVParser is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+
+* FLVParser is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+
+* You should have received a copy of the GNU General Public License
+* along with FLVParser.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "common.h"
+#include "flvstats.h"
+
+#include <sstream>
+#include <string.h>
+
+FLVPARSER_NAMESPACE_BEGIN
+
+static void TrackToJSON(std::ostringstream& out, const TrackStats& track)
+{
+    out << "{\"tags\":" << track._tags
+        << ",\"bytes\":" << track._bytes
+        << ",\"firstTimestamp\":" << track._firstTimestamp
+        << ",\"lastTimestamp\":" << track._lastTimestamp
+        << ",\"bitrate\":" << track._bitrate
+        << ",\"windowBitrateMin\":" << track._windowBitrateMin
+        << ",\"windowBitrateMax\":" << track._windowBitrateMax
+        << ",\"jitterMs\":" << track._jitterMs
+        << ",\"maxStepMs\":" << track._maxStepMs
+        << ",\"gaps\":" << track._gaps
+        << ",\"backwardJumps\":" << track._backwardJumps
+        << ",\"extendedTimestamps\":" << track._extendedTimestamps
+        << "}";
+}
+
+std::string StreamStats::ToJSON() const
+{
+    std::ostringstream out;
+    out << "{\"audio\":";
+    TrackToJSON(out, _audio);
+    out << ",\"video\":";
+    TrackToJSON(out, _video);
+    out << ",\"fps\":" << _fps
+        << ",\"keyframes\":" << _keyframes
+        << ",\"keyframeInterval\":{\"meanMs\":" << _keyframeIntervalMs
+        << ",\"minMs\":" << _keyframeIntervalMinMs
+        << ",\"maxMs\":" << _keyframeIntervalMaxMs << "}"
+        << ",\"gop\":{\"min\":" << _gopMin
+        << ",\"max\":" << _gopMax
+        << ",\"mean\":" << _gopMean
+        << ",\"bucketFrames\":" << _gopBucketFrames
+        << ",\"histogram\":[";
+    for (uint32_t idx = 0; idx < kStatsGopBuckets; idx++)
+    {
+        out << (idx ? "," : "") << _gopHistogram[idx];
+    }
+    out << "]}"
+        << ",\"interleave\":{\"meanMs\":" << _interleaveMeanMs
+        << ",\"maxMs\":" << _interleaveMaxMs << "}"
+        << ",\"avDrift\":{\"endMs\":" << _avDriftMs
+        << ",\"maxMs\":" << _avDriftMaxMs << "}"
+        << "}";
+    return out.str();
+}
+
+StreamAnalyzer::StreamAnalyzer(const StatsOptions& options)
+                : _options(options)
+{
+    if (_options._windowSeconds == 0)
+        _options._windowSeconds = 1;
+    if (_options._windowSeconds > kStatsMaxWindowSeconds)
+        _options._windowSeconds = kStatsMaxWindowSeconds;
+    if (_options._gopBucketFrames == 0)
+        _options._gopBucketFrames = 1;
+    Reset();
+}
+
+void StreamAnalyzer::Reset()
+{
+    _audio = Track();
+    _video = Track();
+    memset(_audio._window, 0, sizeof(_audio._window));
+    memset(_video._window, 0, sizeof(_video._window));
+    _result = StreamStats();
+    memset(_result._gopHistogram, 0, sizeof(_result._gopHistogram));
+    _result._gopBucketFrames = _options._gopBucketFrames;
+    _frames = 0;
+    _interleaveSum = 0;
+    _interleaveCount = 0;
+    _lastKeyframe = 0;
+    _keyframeIntervalSum = 0;
+    _keyframeIntervals = 0;
+    _gopFrames = 0;
+    _gopSum = 0;
+    _gops = 0;
+}
+
+ParsingVideoTag StreamAnalyzer::VideoTagHandler(ParsingVideoTag next)
+{
+    return [this, next](FLVTag* tag, int size, uint32_t preSize,
+                        AVCPacket::AVCPacketHeader* AVCHeader, uint8_t vp6Byte)
+    {
+        OnVideoTag(tag, size, preSize, AVCHeader, vp6Byte);
+        next(tag, size, preSize, AVCHeader, vp6Byte);
+    };
+}
+
+ParsingAudioTag StreamAnalyzer::AudioTagHandler(ParsingAudioTag next)
+{
+    return [this, next](FLVTag* tag, int size, uint32_t preSize, uint8_t AACPacketType)
+    {
+        OnAudioTag(tag, size, preSize, AACPacketType);
+        next(tag, size, preSize, AACPacketType);
+    };
+}
+
+void StreamAnalyzer::Account(Track& track, const FLVTag::FLVTagHeader& header)
+{
+    uint32_t timestamp = TagTimestamp(header);
+    uint32_t size = TagDataSize(header);
+    TrackStats& stats = track._stats;
+    stats._tags++;
+    stats._bytes += size;
+    if (header._timestampExtended)
+        stats._extendedTimestamps++;
+
+    uint32_t windowSeconds = _options._windowSeconds;
+    uint32_t second = timestamp / 1000;
+    if (!track._bSeen)
+    {
+        track._bSeen = true;
+        stats._firstTimestamp = timestamp;
+        track._windowSecond = second;
+    }
+    else if (timestamp < stats._lastTimestamp)
+    {
+        stats._backwardJumps++;
+    }
+    else
+    {
+        uint32_t step = timestamp - stats._lastTimestamp;
+        if (step > _options._gapThresholdMs)
+            stats._gaps++;
+        if (step > stats._maxStepMs)
+            stats._maxStepMs = step;
+        // RFC 3550 style smoothing of the step variation
+        if (stats._tags > 2)
+        {
+            double d = step > track._lastStep ? step - track._lastStep : track._lastStep - step;
+            stats._jitterMs += (d - stats._jitterMs) / 16.0;
+        }
+        track._lastStep = step;
+    }
+    stats._lastTimestamp = timestamp;
+
+    // sliding window of per-second buckets, evaluated every time a second closes
+    while (second > track._windowSecond)
+    {
+        if (track._windowSecond + 1 >= stats._firstTimestamp / 1000 + windowSeconds)
+            track._bWindowFull = true;
+        if (track._bWindowFull)
+        {
+            double bitrate = track._windowBytes * 8.0 / windowSeconds;
+            // a stalled window rates 0 bit/s and has to stay the minimum
+            if (!track._bWindowRated || bitrate > stats._windowBitrateMax)
+                stats._windowBitrateMax = bitrate;
+            if (!track._bWindowRated || bitrate < stats._windowBitrateMin)
+                stats._windowBitrateMin = bitrate;
+            track._bWindowRated = true;
+        }
+        if (second - track._windowSecond >= windowSeconds)
+        {
+            // a gap longer than the window empties it at once; when a whole
+            // window closed in between without a byte, the stall rates 0
+            memset(track._window, 0, sizeof(track._window));
+            if (second - track._windowSecond > windowSeconds)
+            {
+                if (!track._bWindowRated)
+                    stats._windowBitrateMax = 0;
+                stats._windowBitrateMin = 0;
+                track._bWindowFull = track._bWindowRated = true;
+            }
+            track._windowBytes = 0;
+            track._windowSecond = second;
+            break;
+        }
+        track._windowSecond++;
+        uint64_t& expired = track._window[track._windowSecond % windowSeconds];
+        track._windowBytes -= expired;
+        expired = 0;
+    }
+    track._window[track._windowSecond % windowSeconds] += size;
+    track._windowBytes += size;
+}
+
+void StreamAnalyzer::AccountInterleave(uint32_t timestamp, const Track& other)
+{
+    if (other._bSeen)
+    {
+        uint32_t last = other._stats._lastTimestamp;
+        uint32_t distance = timestamp > last ? timestamp - last : last - timestamp;
+        _interleaveSum += distance;
+        _interleaveCount++;
+        if (distance > _result._interleaveMaxMs)
+            _result._interleaveMaxMs = distance;
+    }
+    if (_audio._bSeen && _video._bSeen)
+    {
+        int64_t videoSpan = (int64_t)_video._stats._lastTimestamp - _video._stats._firstTimestamp;
+        int64_t audioSpan = (int64_t)_audio._stats._lastTimestamp - _audio._stats._firstTimestamp;
+        int64_t drift = videoSpan - audioSpan;
+        _result._avDriftMs = drift;
+        if ((drift < 0 ? -drift : drift) > (_result._avDriftMaxMs < 0 ? -_result._avDriftMaxMs : _result._avDriftMaxMs))
+            _result._avDriftMaxMs = drift;
+    }
+}
+
+void StreamAnalyzer::CloseGop()
+{
+    if (_gopFrames == 0)
+        return;
+    if (_gops == 0 || _gopFrames < _result._gopMin)
+        _result._gopMin = _gopFrames;
+    if (_gopFrames > _result._gopMax)
+        _result._gopMax = _gopFrames;
+    uint32_t bucket = (_gopFrames - 1) / _options._gopBucketFrames;
+    if (bucket >= kStatsGopBuckets)
+        bucket = kStatsGopBuckets - 1;
+    _result._gopHistogram[bucket]++;
+    _gopSum += _gopFrames;
+    _gops++;
+    _gopFrames = 0;
+}
+
+void StreamAnalyzer::OnVideoTag(FLVTag* tag, int, uint32_t,
+                                AVCPacket::AVCPacketHeader* AVCHeader, uint8_t)
+{
+    Account(_video, tag->_header);
+    uint32_t timestamp = TagTimestamp(tag->_header);
+    AccountInterleave(timestamp, _audio);
+
+    const VideoTag* video = static_cast<const VideoTag*>(tag->_data);
+    uint8_t frameType = VideoFrameType(video->_header);
+    if (frameType == VideoInfo)
+        return;
+    // sequence headers, end of sequence markers and metadata are not frames
+    if (IsExVideoHeader(video->_header))
+    {
+        if (video->_header._codecID != VideoPacketCodedFrames &&
+            video->_header._codecID != VideoPacketCodedFramesX)
+            return;
+    }
+    else if (video->_header._codecID == AVC && AVCHeader && AVCHeader->_AVCPacketType != 1)
+    {
+        return;
+    }
+    _frames++;
+    if (frameType == KeyFrame || frameType == GeneratedKeyFrame)
+    {
+        if (_result._keyframes > 0 && timestamp >= _lastKeyframe)
+        {
+            uint32_t interval = timestamp - _lastKeyframe;
+            if (_keyframeIntervals == 0 || interval < _result._keyframeIntervalMinMs)
+                _result._keyframeIntervalMinMs = interval;
+            if (interval > _result._keyframeIntervalMaxMs)
+                _result._keyframeIntervalMaxMs = interval;
+            _keyframeIntervalSum += interval;
+            _keyframeIntervals++;
+        }
+        _result._keyframes++;
+        _lastKeyframe = timestamp;
+        CloseGop();
+    }
+    _gopFrames++;
+}
+
+void StreamAnalyzer::OnAudioTag(FLVTag* tag, int, uint32_t, uint8_t)
+{
+    Account(_audio, tag->_header);
+    AccountInterleave(TagTimestamp(tag->_header), _video);
+}
+
+StreamStats StreamAnalyzer::Result() const
+{
+    // finish on a copy so the analyzer can keep running
+    StreamAnalyzer done(*this);
+    done.CloseGop();
+    StreamStats result = done._result;
+
+    const Track* tracks[2] = { &done._audio, &done._video };
+    TrackStats* stats[2] = { &result._audio, &result._video };
+    for (int idx = 0; idx < 2; idx++)
+    {
+        const Track& track = *tracks[idx];
+        TrackStats& out = *stats[idx];
+        out = track._stats;
+        uint32_t span = out._lastTimestamp > out._firstTimestamp ?
+            out._lastTimestamp - out._firstTimestamp : 0;
+        if (span > 0)
+            out._bitrate = out._bytes * 8000.0 / span;
+        if (!track._bWindowRated)
+            out._windowBitrateMin = out._windowBitrateMax = out._bitrate;
+    }
+    uint32_t videoSpan = result._video._lastTimestamp > result._video._firstTimestamp ?
+        result._video._lastTimestamp - result._video._firstTimestamp : 0;
+    if (done._frames > 1 && videoSpan > 0)
+        result._fps = (done._frames - 1) * 1000.0 / videoSpan;
+    if (done._keyframeIntervals > 0)
+        result._keyframeIntervalMs = (double)done._keyframeIntervalSum / done._keyframeIntervals;
+    if (done._gops > 0)
+        result._gopMean = (double)done._gopSum / done._gops;
+    if (done._interleaveCount > 0)
+        result._interleaveMeanMs = (double)done._interleaveSum / done._interleaveCount;
+    return result;
+}
+
+FLVPARSER_NAMESPACE_END
@@ -0,0 +1,128 @@
+/**
+* This file is part of FLVParser.
+
+* FLVParser is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+
+* FLVParser is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+
+* You should have received a copy of the GNU General Public License
+* along with FLVParser.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef FLVSTATS_H_
+#define FLVSTATS_H_
+
+#include "common.h"
+#include "flvparser.h"
+
+#include <string>
+
+FLVPARSER_NAMESPACE_BEGIN
+
+static const uint32_t kStatsMaxWindowSeconds = 64;
+static const uint32_t kStatsGopBuckets       = 32;
+
+struct StatsOptions
+{
+    uint32_t        _windowSeconds      { 5 };      //!< Sliding bitrate window, at most kStatsMaxWindowSeconds
+    uint32_t        _gapThresholdMs     { 1000 };   //!< Timestamp steps above this count as gaps
+    uint32_t        _gopBucketFrames    { 10 };     //!< Width of one GOP length histogram bucket
+};
+
+struct TrackStats
+{
+    uint64_t        _tags               { 0 };
+    uint64_t        _bytes              { 0 };      //!< Sum of the tag DataSize
+    uint32_t        _firstTimestamp     { 0 };
+    uint32_t        _lastTimestamp      { 0 };
+    double          _bitrate            { 0 };      //!< Average over the whole track in bit/s
+    double          _windowBitrateMin   { 0 };      //!< Sliding window bitrate range in bit/s
+    double          _windowBitrateMax   { 0 };
+    double          _jitterMs           { 0 };      //!< Smoothed variation of the timestamp steps
+    uint32_t        _maxStepMs          { 0 };
+    uint32_t        _gaps               { 0 };
+    uint32_t        _backwardJumps      { 0 };
+    uint32_t        _extendedTimestamps { 0 };      //!< Tags using _timestampExtended
+};
+
+struct StreamStats
+{
+    TrackStats      _audio;
+    TrackStats      _video;
+    double          _fps                    { 0 };
+    uint64_t        _keyframes              { 0 };
+    double          _keyframeIntervalMs     { 0 };  //!< Mean distance between keyframes
+    uint32_t        _keyframeIntervalMinMs  { 0 };
+    uint32_t        _keyframeIntervalMaxMs  { 0 };
+    uint32_t        _gopMin                 { 0 };  //!< GOP length in frames
+    uint32_t        _gopMax                 { 0 };
+    double          _gopMean                { 0 };
+    uint32_t        _gopBucketFrames        { 0 };
+    uint32_t        _gopHistogram[kStatsGopBuckets];
+    double          _interleaveMeanMs       { 0 };  //!< Distance to the last tag of the other track
+    uint32_t        _interleaveMaxMs        { 0 };
+    int64_t         _avDriftMs              { 0 };  //!< Video span minus audio span at the end
+    int64_t         _avDriftMaxMs           { 0 };  //!< Largest drift seen, signed
+
+    std::string     ToJSON() const;
+};
+
+// Single pass stream analyzer driven by the parser callbacks, the memory it
+// uses does not depend on the stream length
+class StreamAnalyzer
+{
+public:
+    StreamAnalyzer(const StatsOptions& options = StatsOptions());
+
+    void                OnVideoTag(FLVTag* tag, int size, uint32_t preSize,
+                                   AVCPacket::AVCPacketHeader* AVCHeader, uint8_t vp6Byte);
+    void                OnAudioTag(FLVTag* tag, int size, uint32_t preSize, uint8_t AACPacketType);
+
+    // Callbacks feeding the analyzer and then forwarding to next
+    ParsingVideoTag     VideoTagHandler(ParsingVideoTag next = &DoNothingOnVideoTag);
+    ParsingAudioTag     AudioTagHandler(ParsingAudioTag next = &DoNothingOnAudioTag);
+
+    StreamStats         Result() const;
+    void                Reset();
+
+private:
+    struct Track
+    {
+        TrackStats      _stats;
+        uint64_t        _window[kStatsMaxWindowSeconds];
+        uint64_t        _windowBytes    { 0 };
+        uint32_t        _windowSecond   { 0 };      //!< Newest second accounted in the window
+        uint32_t        _lastStep       { 0 };
+        bool            _bSeen          { false };
+        bool            _bWindowFull    { false };
+        bool            _bWindowRated   { false };  //!< A full window set the bitrate range
+    };
+
+    void                Account(Track& track, const FLVTag::FLVTagHeader& header);
+    void                AccountInterleave(uint32_t timestamp, const Track& other);
+    void                CloseGop();
+
+    StatsOptions        _options;
+    Track               _audio;
+    Track               _video;
+    StreamStats         _result;
+    uint64_t            _frames             { 0 };
+    uint64_t            _interleaveSum      { 0 };
+    uint64_t            _interleaveCount    { 0 };
+    uint32_t            _lastKeyframe       { 0 };
+    uint64_t            _keyframeIntervalSum { 0 };
+    uint64_t            _keyframeIntervals  { 0 };  //!< Added to the sum, backward jumps are not
+    uint32_t            _gopFrames          { 0 };
+    uint64_t            _gopSum             { 0 };
+    uint64_t            _gops               { 0 };
+};
+
+FLVPARSER_NAMESPACE_END
+
+#endif // FLVSTATS_H_
@@ -0,0 +1,297 @@
+/**
+* This file is part of FLVParser.
+
+* FLVParser is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+
+* FLVParser is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+
+* You should have received a copy of the GNU General Public License
+* along with FLVParser.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "common.h"
+#include "flvvalidator.h"
+
+FLVPARSER_NAMESPACE_BEGIN
+
+const char* ViolationName(ViolationType type)
+{
+    switch (type)
+    {
+    case ViolationSignature:
+        return "signature";
+    case ViolationHeaderReserved:
+        return "header reserved bits";
+    case ViolationDataOffset:
+        return "header data offset";
+    case ViolationPreviousTagSize0:
+        return "PreviousTagSize0";
+    case ViolationTagReserved:
+        return "tag reserved bits";
+    case ViolationUnknownTagType:
+        return "unknown tag type";
+    case ViolationStreamID:
+        return "StreamID";
+    case ViolationPreviousTagSize:
+        return "PreviousTagSize";
+    case ViolationTimestampBackwards:
+        return "timestamp backwards";
+    case ViolationCompositionTime:
+        return "composition time";
+    case ViolationMissingSequenceHeader:
+        return "missing sequence header";
+    case ViolationTagTooSmall:
+        return "tag too small";
+    case ViolationTruncated:
+        return "truncated";
+    default:
+        return "unknown";
+    }
+}
+
+static inline uint32_t ReadUInt32BE(const uint8_t* p)
+{
+    return ((uint32_t)p[0] << 24) | (p[1] << 16) | (p[2] << 8) | p[3];
+}
+
+FLVValidator::FLVValidator(const char* inputFile, const ValidatorOptions& options)
+                : _fileReader(new FileReader(inputFile)),
+                  _source(_fileReader.get()),
+                  _options(options)
+{
+
+}
+
+FLVValidator::FLVValidator(ByteSource* source, const ValidatorOptions& options)
+                : _source(source),
+                  _options(options)
+{
+    if (!source)
+    {
+        std::cerr << "[failed]: input byte source is null" << std::endl;
+        throw "[failed]";
+    }
+}
+
+bool FLVValidator::Report(ViolationType type, uint64_t offset, int64_t value, int64_t expected)
+{
+    Violation violation = { type, offset, value, expected };
+    _violations.push_back(violation);
+    return _options._maxViolations == 0 || _violations.size() < _options._maxViolations;
+}
+
+bool FLVValidator::Validate()
+{
+    _violations.clear();
+    _tags = 0;
+    _bAudioSeen = _bVideoSeen = _bScriptSeen = false;
+    _bVideoHeaderSeen = _bAACHeaderSeen = false;
+    if (_source->Tell() != 0 && !_source->Rewind())
+    {
+        std::cerr << "[failed]: the byte source can not be rewound" << std::endl;
+        return false;
+    }
+    if (ValidateHeader())
+    {
+        while (ValidateTag())
+            ;
+    }
+    return _violations.empty();
+}
+
+bool FLVValidator::ValidateHeader()
+{
+    FLVHeader header;
+    if (_source->Read(&header, sizeof(header)) != sizeof(header))
+    {
+        Report(ViolationTruncated, 0, 0, sizeof(header));
+        return false;
+    }
+    if (header._signature[0] != 'F' || header._signature[1] != 'L' || header._signature[2] != 'V')
+    {
+        // not an flv file, nothing else is meaningful
+        Report(ViolationSignature, 0, (header._signature[0] << 16) | (header._signature[1] << 8) |
+               header._signature[2], ('F' << 16) | ('L' << 8) | 'V');
+        return false;
+    }
+    if ((header._typeFlagsReserved1 || header._typeFlagsReserved2) &&
+        !Report(ViolationHeaderReserved, 4, header._typeFlagsReserved1 << 1 | header._typeFlagsReserved2, 0))
+        return false;
+    uint32_t dataOffset = ReadUInt32BE(header._dataOffset);
+    if (dataOffset != sizeof(FLVHeader))
+    {
+        if (!Report(ViolationDataOffset, 5, dataOffset, sizeof(FLVHeader)))
+            return false;
+        // the body starts at _dataOffset, a too small one is ignored
+        if (dataOffset > sizeof(FLVHeader) && !_source->Skip(dataOffset - sizeof(FLVHeader)))
+        {
+            Report(ViolationTruncated, sizeof(FLVHeader), 0, dataOffset);
+            return false;
+        }
+    }
+    uint64_t offset = _source->Tell();
+    uint8_t previousTagSize0[4];
+    if (_source->Read(previousTagSize0, sizeof(previousTagSize0)) != sizeof(previousTagSize0))
+    {
+        Report(ViolationTruncated, offset, 0, sizeof(previousTagSize0));
+        return false;
+    }
+    uint32_t value = ReadUInt32BE(previousTagSize0);
+    if (value != 0)
+        return Report(ViolationPreviousTagSize0, offset, value, 0);
+    return true;
+}
+
+bool FLVValidator::ValidateTag()
+{
+    uint64_t offset = _source->Tell();
+    FLVTag::FLVTagHeader header;
+    size_t size = _source->Read(&header, sizeof(header));
+    if (size == 0)
+        return false;
+    if (size < sizeof(header))
+    {
+        Report(ViolationTruncated, offset, size, sizeof(header));
+        return false;
+    }
+    _tags++;
+    uint32_t dataSize = TagDataSize(header);
+    uint32_t timestamp = TagTimestamp(header);
+
+    if (header._reserved && !Report(ViolationTagReserved, offset, header._reserved, 0))
+        return false;
+    uint32_t streamID = (header._streamID[0] << 16) | (header._streamID[1] << 8) | header._streamID[2];
+    if (streamID != 0 && !Report(ViolationStreamID, offset + 8, streamID, 0))
+        return false;
+
+    // only the media headers in front of the payload are read
+    uint8_t media[kMaxVideoHeaderSize];
+    uint32_t want = 0;
+    uint32_t minimum = 0;
+    uint32_t* last = nullptr;
+    bool* bSeen = nullptr;
+    uint64_t mediaOffset = offset + sizeof(header);
+    switch (header._tagType)
+    {
+    case TagTypeAudio:
+        want = 2;
+        minimum = 1;
+        last = &_lastAudio;
+        bSeen = &_bAudioSeen;
+        break;
+    case TagTypeVideo:
+        want = kMaxVideoHeaderSize;
+        minimum = 1;
+        last = &_lastVideo;
+        bSeen = &_bVideoSeen;
+        break;
+    case TagTypeScript:
+        last = &_lastScript;
+        bSeen = &_bScriptSeen;
+        break;
+    default:
+        if (!Report(ViolationUnknownTagType, offset, header._tagType, 0))
+            return false;
+        break;
+    }
+    if (want > dataSize)
+        want = dataSize;
+    if (dataSize < minimum && !Report(ViolationTagTooSmall, offset, dataSize, minimum))
+        return false;
+    if (want > 0 && _source->Read(media, want) != want)
+    {
+        Report(ViolationTruncated, offset, dataSize, dataSize);
+        return false;
+    }
+
+    if (last)
+    {
+        if (*bSeen && timestamp < *last && !Report(ViolationTimestampBackwards, offset + 4, timestamp, *last))
+            return false;
+        *last = timestamp;
+        *bSeen = true;
+    }
+
+    if (header._tagType == TagTypeAudio && want > 0)
+    {
+        const AudioTag::AudioTagHeader* audio = (const AudioTag::AudioTagHeader*)media;
+        if (audio->_soundFormat == AAC)
+        {
+            if (want < 2)
+            {
+                if (!Report(ViolationTagTooSmall, offset, dataSize, 2))
+                    return false;
+            }
+            else if (media[1] == AACSequenceHeader)
+            {
+                _bAACHeaderSeen = true;
+            }
+            else if (!_bAACHeaderSeen && !Report(ViolationMissingSequenceHeader, offset, media[1], AACSequenceHeader))
+            {
+                return false;
+            }
+        }
+    }
+    else if (header._tagType == TagTypeVideo && want > 0)
+    {
+        VideoHeaderInfo video;
+        bool bComplete = ParseVideoHeader(media, want, video);
+        bool bEnhanced = video._bEnhanced && video._packetType <= VideoPacketMPEG2TSSequenceStart;
+        if ((video._codecID == AVC || bEnhanced) && video._frameType != VideoInfo)
+        {
+            if (!bComplete)
+            {
+                // only HEVC coded frames need more than the FourCC
+                uint32_t needed = want < 5 ? 5 : kMaxVideoHeaderSize;
+                if (!Report(ViolationTagTooSmall, offset, dataSize, needed))
+                    return false;
+            }
+            else
+            {
+                int32_t compositionTime = video._compositionTime;
+                uint64_t compositionOffset = mediaOffset + (video._bEnhanced ? 5 : 2);
+                if (video._bSequenceHeader)
+                {
+                    _bVideoHeaderSeen = true;
+                }
+                else if (video._bCodedFrame && !_bVideoHeaderSeen &&
+                         !Report(ViolationMissingSequenceHeader, offset, video._packetType, 0))
+                {
+                    return false;
+                }
+                if (!video._bCodedFrame && compositionTime != 0 &&
+                    !Report(ViolationCompositionTime, compositionOffset, compositionTime, 0))
+                    return false;
+                if (video._bCodedFrame && (int64_t)timestamp + compositionTime < 0 &&
+                    !Report(ViolationCompositionTime, compositionOffset, compositionTime, -(int64_t)timestamp))
+                    return false;
+            }
+        }
+    }
+
+    if (!_source->Skip(dataSize - want))
+    {
+        Report(ViolationTruncated, offset, dataSize, dataSize);
+        return false;
+    }
+    uint64_t previousOffset = _source->Tell();
+    uint8_t previousTagSize[4];
+    if (_source->Read(previousTagSize, sizeof(previousTagSize)) != sizeof(previousTagSize))
+    {
+        Report(ViolationTruncated, offset, dataSize, dataSize);
+        return false;
+    }
+    uint32_t value = ReadUInt32BE(previousTagSize);
+    if (value != sizeof(header) + dataSize &&
+        !Report(ViolationPreviousTagSize, previousOffset, value, sizeof(header) + dataSize))
+        return false;
+    return true;
+}
+
+FLVPARSER_NAMESPACE_END
@@ -0,0 +1,100 @@
+/**
+* This file is part of FLVParser.
+
+* FLVParser is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+
+* FLVParser is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+
+* You should have received a copy of the GNU General Public License
+* along with FLVParser.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef FLVVALIDATOR_H_
+#define FLVVALIDATOR_H_
+
+#include "common.h"
+#include "flvparser.h"
+
+#include <memory>
+#include <vector>
+
+FLVPARSER_NAMESPACE_BEGIN
+
+enum ViolationType
+{
+    ViolationSignature = 0,             //!< Header does not start with "FLV"
+    ViolationHeaderReserved,            //!< _typeFlagsReserved1/2 are not 0
+    ViolationDataOffset,                //!< Header _dataOffset is not 9
+    ViolationPreviousTagSize0,          //!< First PreviousTagSize is not 0
+    ViolationTagReserved,               //!< Tag _reserved bits are not 0
+    ViolationUnknownTagType,
+    ViolationStreamID,                  //!< StreamID is not 0
+    ViolationPreviousTagSize,           //!< PreviousTagSize != 11 + DataSize
+    ViolationTimestampBackwards,        //!< DTS decreases within a track
+    ViolationCompositionTime,           //!< CTS not 0 outside coded frames, or PTS < 0
+    ViolationMissingSequenceHeader,     //!< AVC/AAC/enhanced video frame before its sequence header
+    ViolationTagTooSmall,               //!< DataSize shorter than the media headers
+    ViolationTruncated                  //!< Input ends inside a tag
+};
+
+const char* ViolationName(ViolationType type);
+
+struct Violation
+{
+    ViolationType   _type;
+    uint64_t        _offset;            //!< Byte offset of the header or field at fault
+    int64_t         _value;             //!< Value found
+    int64_t         _expected;          //!< Value expected, when there is a single one
+};
+
+struct ValidatorOptions
+{
+    size_t          _maxViolations  { 0 };      //!< Stop after that many, 0 reports all
+};
+
+// Structural validation reading only the tag headers and the first media
+// header bytes, payloads are skipped through ByteSource::Skip
+class FLVValidator
+{
+public:
+    FLVValidator(const char* inputFile, const ValidatorOptions& options = ValidatorOptions());
+    // The source is not owned by the validator
+    FLVValidator(ByteSource* source, const ValidatorOptions& options = ValidatorOptions());
+
+    FLVValidator(const FLVValidator&)               = delete;
+    FLVValidator& operator= (const FLVValidator&)   = delete;
+
+    //! True when the input has no violation
+    bool                            Validate();
+    const std::vector<Violation>&   Violations() const  { return _violations; }
+    uint64_t                        Tags() const        { return _tags; }
+
+private:
+    bool                ValidateHeader();
+    bool                ValidateTag();
+    bool                Report(ViolationType type, uint64_t offset, int64_t value, int64_t expected = 0);
+
+    std::unique_ptr<FileReader> _fileReader;
+    ByteSource*         _source;
+    ValidatorOptions    _options;
+    std::vector<Violation> _violations;
+    uint64_t            _tags               { 0 };
+    uint32_t            _lastAudio          { 0 };
+    uint32_t            _lastVideo          { 0 };
+    uint32_t            _lastScript         { 0 };
+    bool                _bAudioSeen         { false };
+    bool                _bVideoSeen         { false };
+    bool                _bScriptSeen        { false };
+    bool                _bVideoHeaderSeen   { false };  //!< AVC sequence header or enhanced SequenceStart
+    bool                _bAACHeaderSeen     { false };
+};
+
+FLVPARSER_NAMESPACE_END
+
+#endif // FLVVALIDATOR_H_
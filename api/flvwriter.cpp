@@ -0,0 +1,247 @@
+/**
+* This file is part of FLVParser.
+
+* FLVParser is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+
+* FLVParser is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+
+* You should have received a copy of the GNU General Public License
+* along with FLVParser.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "common.h"
+#include "flvwriter.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+
+FLVPARSER_NAMESPACE_BEGIN
+
+// iovec entries handed to one writev(), well below IOV_MAX
+static const int kWriteBatch = 256;
+
+FLVWriter::FLVWriter(const char* outputFile, size_t bufferSize)
+                : _capacity(bufferSize < 4096 ? 4096 : bufferSize)
+{
+    if (!outputFile)
+    {
+        std::cerr << "[failed]: output file path is null" << std::endl;
+        throw "[failed]";
+    }
+    _fd = open(outputFile, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (_fd < 0)
+    {
+        std::cerr << "[failed]: could not create the " << outputFile << std::endl;
+        throw "[failed]";
+    }
+    _buffer.reset(new uint8_t[_capacity]);
+}
+
+FLVWriter::~FLVWriter()
+{
+    Flush();
+    if (_fd >= 0)
+        close(_fd);
+}
+
+bool FLVWriter::WriteAll(const iovec* iov, int count)
+{
+    // a private copy of every batch, a short write continues mid vector
+    iovec vec[kWriteBatch];
+    while (count > 0)
+    {
+        int batch = count > kWriteBatch ? kWriteBatch : count;
+        memcpy(vec, iov, batch * sizeof(iovec));
+        iov += batch;
+        count -= batch;
+        int first = 0;
+        while (first < batch)
+        {
+            ssize_t written = writev(_fd, vec + first, batch - first);
+            _writeCalls++;
+            if (written < 0)
+            {
+                if (errno == EINTR)
+                    continue;
+                std::cerr << "[failed]: write to the output file failed: " << strerror(errno) << std::endl;
+                return false;
+            }
+            _flushed += written;
+            while (first < batch && (size_t)written >= vec[first].iov_len)
+                written -= vec[first++].iov_len;
+            if (first < batch)
+            {
+                vec[first].iov_base = (uint8_t*)vec[first].iov_base + written;
+                vec[first].iov_len -= written;
+            }
+        }
+    }
+    return true;
+}
+
+bool FLVWriter::Flush()
+{
+    if (_used == 0 || _fd < 0)
+        return true;
+    iovec vec = { _buffer.get(), _used };
+    _used = 0;
+    return WriteAll(&vec, 1);
+}
+
+bool FLVWriter::Write(const void* data, size_t size)
+{
+    if (_used + size <= _capacity)
+    {
+        memcpy(_buffer.get() + _used, data, size);
+        _used += size;
+        return true;
+    }
+    iovec vec[2] = { { _buffer.get(), _used }, { (void*)data, size } };
+    _used = 0;
+    return WriteAll(vec, 2);
+}
+
+bool FLVWriter::WriteVector(const iovec* iov, int count)
+{
+    return Flush() && WriteAll(iov, count);
+}
+
+bool FLVWriter::WriteHeader(bool bAudio, bool bVideo)
+{
+    uint8_t header[13] = { 'F', 'L', 'V', 0x01, 0, 0, 0, 0, 9, 0, 0, 0, 0 };
+    header[4] = (bAudio ? 0x04 : 0) | (bVideo ? 0x01 : 0);
+    return Write(header, sizeof(header));
+}
+
+bool FLVWriter::WriteTag(const FLVTag::FLVTagHeader& header,
+                         const void* media, size_t mediaSize,
+                         const void* payload, size_t payloadSize)
+{
+    uint32_t dataSize = (uint32_t)(mediaSize + payloadSize);
+    FLVTag::FLVTagHeader out = header;
+    SetTagDataSize(out, dataSize);
+    uint32_t previousTagSize = sizeof(FLVTag::FLVTagHeader) + dataSize;
+    uint8_t trailer[4] = { (uint8_t)(previousTagSize >> 24), (uint8_t)(previousTagSize >> 16),
+                           (uint8_t)(previousTagSize >> 8), (uint8_t)previousTagSize };
+
+    size_t total = previousTagSize + sizeof(trailer);
+    if (_used + total <= _capacity)
+    {
+        uint8_t* p = _buffer.get() + _used;
+        memcpy(p, &out, sizeof(out));
+        p += sizeof(out);
+        if (mediaSize)
+            memcpy(p, media, mediaSize);
+        p += mediaSize;
+        if (payloadSize)
+            memcpy(p, payload, payloadSize);
+        p += payloadSize;
+        memcpy(p, trailer, sizeof(trailer));
+        _used += total;
+        return true;
+    }
+    // the large payload is written straight from the caller's memory
+    if (!Flush())
+        return false;
+    iovec vec[4] = {
+        { &out, sizeof(out) },
+        { (void*)media, mediaSize },
+        { (void*)payload, payloadSize },
+        { trailer, sizeof(trailer) }
+    };
+    return WriteAll(vec, 4);
+}
+
+bool FLVWriter::CopyFrom(int fd, uint64_t offset, uint64_t size)
+{
+    if (!Flush())
+        return false;
+#ifdef FLVPARSER_HAVE_COPY_FILE_RANGE
+    while (_bCopyFileRange && size > 0)
+    {
+        loff_t in = (loff_t)offset;
+        ssize_t copied = copy_file_range(fd, &in, _fd, nullptr, size, 0);
+        if (copied > 0)
+        {
+            offset += copied;
+            size -= copied;
+            _flushed += copied;
+            _kernelCopied += copied;
+            _writeCalls++;
+            continue;
+        }
+        if (copied < 0 && errno == EINTR)
+            continue;
+        if (copied == 0)
+        {
+            std::cerr << "[failed]: the input file ended while copying" << std::endl;
+            return false;
+        }
+        // another file system or no kernel support: copy through the buffer
+        if (errno != EXDEV && errno != ENOSYS && errno != EINVAL && errno != EOPNOTSUPP)
+        {
+            std::cerr << "[failed]: copy_file_range failed: " << strerror(errno) << std::endl;
+            return false;
+        }
+        _bCopyFileRange = false;
+    }
+#endif
+    while (size > 0)
+    {
+        size_t chunk = size < _capacity ? (size_t)size : _capacity;
+        ssize_t got = pread(fd, _buffer.get(), chunk, (off_t)offset);
+        if (got < 0 && errno == EINTR)
+            continue;
+        if (got <= 0)
+        {
+            std::cerr << "[failed]: read from the input file failed" << std::endl;
+            return false;
+        }
+        _used = got;
+        if (!Flush())
+            return false;
+        offset += got;
+        size -= got;
+    }
+    return true;
+}
+
+bool FLVWriter::Patch(uint64_t offset, const void* data, size_t size)
+{
+    if (offset + size > Tell())
+        return false;
+    const uint8_t* bytes = static_cast<const uint8_t*>(data);
+    // the part still in the buffer is patched in place
+    if (offset + size > _flushed)
+    {
+        uint64_t start = offset > _flushed ? offset : _flushed;
+        size_t count = (size_t)(offset + size - start);
+        memcpy(_buffer.get() + (start - _flushed), bytes + (start - offset), count);
+        size -= count;
+    }
+    while (size > 0)
+    {
+        ssize_t written = pwrite(_fd, bytes, size, (off_t)offset);
+        if (written < 0 && errno == EINTR)
+            continue;
+        if (written <= 0)
+        {
+            std::cerr << "[failed]: patching the output file failed" << std::endl;
+            return false;
+        }
+        bytes += written;
+        offset += written;
+        size -= written;
+    }
+    return true;
+}
+
+FLVPARSER_NAMESPACE_END
@@ -0,0 +1,78 @@
+/**
+* This file is part of FLVParser.
+
+* FLVParser is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+
+* FLVParser is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+
+* You should have received a copy of the GNU General Public License
+* along with FLVParser.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef FLVWRITER_H_
+#define FLVWRITER_H_
+
+#include "common.h"
+#include "flvparser.h"
+
+#include <memory>
+#include <stddef.h>
+#include <sys/uio.h>
+
+FLVPARSER_NAMESPACE_BEGIN
+
+// Buffered FLV output. Small tags are gathered in one large buffer, a
+// payload that does not fit is written together with the buffer through a
+// single writev(), and whole byte ranges of another file can be copied in
+// the kernel with copy_file_range() when the platform has it.
+class FLVWriter
+{
+public:
+    explicit FLVWriter(const char* outputFile, size_t bufferSize = 1 << 20);
+    ~FLVWriter();
+
+    FLVWriter(const FLVWriter&)             = delete;
+    FLVWriter& operator= (const FLVWriter&) = delete;
+
+    //! The 9 bytes header and PreviousTagSize0
+    bool                WriteHeader(bool bAudio, bool bVideo);
+    //! One tag: DataSize and the trailing PreviousTagSize are computed from
+    //! mediaSize + payloadSize, the rest of the header is taken as is
+    bool                WriteTag(const FLVTag::FLVTagHeader& header,
+                                 const void* media, size_t mediaSize,
+                                 const void* payload, size_t payloadSize);
+    bool                Write(const void* data, size_t size);
+    //! Gathered write straight from the caller's memory, buffered bytes go first
+    bool                WriteVector(const iovec* iov, int count);
+    //! Appends size bytes of fd starting at offset
+    bool                CopyFrom(int fd, uint64_t offset, uint64_t size);
+    //! Overwrites bytes that were already written, the size stays the same
+    bool                Patch(uint64_t offset, const void* data, size_t size);
+    bool                Flush();
+
+    uint64_t            Tell() const        { return _flushed + _used; }
+    uint64_t            WriteCalls() const  { return _writeCalls; }
+    uint64_t            KernelCopiedBytes() const { return _kernelCopied; }
+
+private:
+    bool                WriteAll(const iovec* iov, int count);
+
+    int                 _fd             { -1 };
+    std::unique_ptr<uint8_t[]> _buffer;
+    size_t              _capacity;
+    size_t              _used           { 0 };
+    uint64_t            _flushed        { 0 };  //!< Bytes already handed to the kernel
+    uint64_t            _writeCalls     { 0 };
+    uint64_t            _kernelCopied   { 0 };
+    bool                _bCopyFileRange { true };
+};
+
+FLVPARSER_NAMESPACE_END
+
+#endif // FLVWRITER_H_
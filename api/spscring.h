@@ -0,0 +1,108 @@
+/**
+* This file is part of FLVParser.
+
+* FLVParser is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+
+* FLVParser is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+
+* You should have received a copy of the GNU General Public License
+* along with FLVParser.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef SPSCRING_H_
+#define SPSCRING_H_
+
+#include "common.h"
+
+#include <atomic>
+#include <stddef.h>
+#include <utility>
+#include <vector>
+
+FLVPARSER_NAMESPACE_BEGIN
+
+// Bounded lock-free ring for exactly one producer thread and one consumer
+// thread. The capacity is rounded up to a power of two.
+template <typename T>
+class SpscRing
+{
+public:
+    explicit SpscRing(size_t capacity)
+    {
+        size_t size = 2;
+        while (size < capacity)
+            size <<= 1;
+        _slots.resize(size);
+        _mask = size - 1;
+    }
+
+    SpscRing(const SpscRing&)               = delete;
+    SpscRing& operator= (const SpscRing&)   = delete;
+
+    // producer side
+    bool TryPush(T&& value)
+    {
+        size_t tail = _tail.load(std::memory_order_relaxed);
+        if (tail - _head.load(std::memory_order_acquire) > _mask)
+            return false;
+        _slots[tail & _mask] = std::move(value);
+        _tail.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    bool TryPush(const T& value)
+    {
+        T copy(value);
+        return TryPush(std::move(copy));
+    }
+
+    size_t Free() const
+    {
+        return Capacity() - Size();
+    }
+
+    // consumer side
+    bool TryPop(T& value)
+    {
+        size_t head = _head.load(std::memory_order_relaxed);
+        if (head == _tail.load(std::memory_order_acquire))
+            return false;
+        value = std::move(_slots[head & _mask]);
+        _slots[head & _mask] = T();
+        _head.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+    // either side, approximate while the other side is running
+    size_t Size() const
+    {
+        size_t head = _head.load(std::memory_order_acquire);
+        return _tail.load(std::memory_order_acquire) - head;
+    }
+
+    size_t Capacity() const     { return _mask + 1; }
+
+private:
+    // The indices are kept a cache line apart with explicit padding rather
+    // than alignas: C++11 new only guarantees alignof(max_align_t), so an
+    // over-aligned member would not survive a heap allocated ring.
+    enum { kCacheLine = 64 };
+
+    std::vector<T>              _slots;
+    size_t                      _mask;
+    char                        _pad0[kCacheLine];
+    std::atomic<size_t>         _head { 0 };    //!< Written by the consumer
+    char                        _pad1[kCacheLine - sizeof(std::atomic<size_t>)];
+    std::atomic<size_t>         _tail { 0 };    //!< Written by the producer
+    char                        _pad2[kCacheLine - sizeof(std::atomic<size_t>)];
+};
+
+FLVPARSER_NAMESPACE_END
+
+#endif // SPSCRING_H_
@@ -0,0 +1,92 @@
+/**
+* This file is part of FLVParser.
+
+* FLVParser is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+
+* FLVParser is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+
+* You should have received a copy of the GNU General Public License
+* along with FLVParser.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "../api/flvparser.h"
+
+#include <chrono>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+using namespace flvparser;
+
+// Drop the file pages from the page cache so every round starts cold
+static bool EvictFromPageCache(const char* path)
+{
+    int fd = open(path, O_RDONLY);
+    if (fd < 0)
+        return false;
+    int ret = posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+    close(fd);
+    return ret == 0;
+}
+
+static void RunBackend(const char* path, ReadBackend backend, uint32_t depth,
+                       uint32_t blockSize, bool bCold)
+{
+    ReadOptions options;
+    options._backend = backend;
+    options._queueDepth = depth;
+    options._blockSize = blockSize;
+    if (bCold && !EvictFromPageCache(path))
+        std::cerr << "[warning]: could not evict " << path << " from the page cache" << std::endl;
+
+    FLVParser parser(path, options);
+    auto start = std::chrono::steady_clock::now();
+    bool bOk = parser.Parse();
+    auto end = std::chrono::steady_clock::now();
+    double seconds = std::chrono::duration<double>(end - start).count();
+
+    int fd = open(path, O_RDONLY);
+    off_t size = fd >= 0 ? lseek(fd, 0, SEEK_END) : 0;
+    if (fd >= 0)
+        close(fd);
+    double mb = size / (1024.0 * 1024.0);
+    std::cout << ReadBackendName(backend) << " (using " << ReadBackendName(parser.Backend()) << ")"
+              << (bCold ? " cold" : " warm") << ": "
+              << seconds * 1000.0 << " ms, "
+              << (seconds > 0 ? mb / seconds : 0) << " MB/s"
+              << (bOk ? "" : " [parse failed]") << std::endl;
+}
+
+int main(int argc, const char* argv[])
+{
+    if (argc < 2)
+    {
+        std::cerr << "[Usage]: bench_io inputfile [queueDepth] [blockSizeKB] [rounds]" << std::endl;
+        return 1;
+    }
+    uint32_t depth = argc > 2 ? atoi(argv[2]) : 4;
+    uint32_t blockSize = (argc > 3 ? atoi(argv[3]) : 1024) * 1024;
+    int rounds = argc > 4 ? atoi(argv[4]) : 3;
+    try
+    {
+        for (int round = 0; round < rounds; round++)
+        {
+            RunBackend(argv[1], ReadBackendPread, depth, blockSize, true);
+            RunBackend(argv[1], ReadBackendIoUring, depth, blockSize, true);
+        }
+        RunBackend(argv[1], ReadBackendPread, depth, blockSize, false);
+        RunBackend(argv[1], ReadBackendIoUring, depth, blockSize, false);
+    }
+    catch (char const*)
+    {
+        std::cerr << "FLVParser init failed!" << std::endl;
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,408 @@
+/**
+* This file is part of FLVParser.
+
+* FLVParser is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+
+* FLVParser is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+
+* You should have received a copy of the GNU General Public License
+* along with FLVParser.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "../api/flvchecksum.h"
+#include "../api/flvparser.h"
+#include "../api/flvstats.h"
+#include "../api/flvvalidator.h"
+#include "flvgen.h"
+
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <new>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <sys/resource.h>
+#include <unistd.h>
+#include <vector>
+
+using namespace flvparser;
+
+// Every heap allocation of the process is counted, whatever the build options
+static std::atomic<uint64_t> g_allocations(0);
+
+void* operator new(size_t size)
+{
+    g_allocations.fetch_add(1, std::memory_order_relaxed);
+    void* p = malloc(size ? size : 1);
+    if (!p)
+        throw std::bad_alloc();
+    return p;
+}
+
+void* operator new[](size_t size)
+{
+    return operator new(size);
+}
+
+void operator delete(void* p) noexcept
+{
+    free(p);
+}
+
+void operator delete[](void* p) noexcept
+{
+    free(p);
+}
+
+void operator delete(void* p, size_t) noexcept
+{
+    free(p);
+}
+
+void operator delete[](void* p, size_t) noexcept
+{
+    free(p);
+}
+
+// Peak RSS of the current mode: the high water mark is reset through
+// clear_refs when the kernel allows it, otherwise it is the process peak
+static void ResetPeakRSS()
+{
+    std::ofstream clearRefs("/proc/self/clear_refs");
+    if (clearRefs)
+        clearRefs << "5";
+}
+
+static uint64_t PeakRSSKB()
+{
+    std::ifstream status("/proc/self/status");
+    std::string line;
+    while (std::getline(status, line))
+    {
+        if (line.compare(0, 6, "VmHWM:") == 0)
+            return strtoull(line.c_str() + 6, nullptr, 10);
+    }
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_maxrss;
+}
+
+struct ModeResult
+{
+    bool        _bOk    { false };
+    uint64_t    _tags   { 0 };
+};
+
+static void Report(const char* mode, const ModeResult& result, double seconds,
+                   uint64_t bytes, uint64_t allocations, uint64_t peakKB)
+{
+    double mb = bytes / (1024.0 * 1024.0);
+    printf("%-22s %10llu %14.0f %10.1f %10.3f %10llu%s\n", mode,
+           (unsigned long long)result._tags,
+           seconds > 0 ? result._tags / seconds : 0.0,
+           seconds > 0 ? mb / seconds : 0.0,
+           result._tags ? (double)allocations / result._tags : 0.0,
+           (unsigned long long)peakKB,
+           result._bOk ? "" : "  [failed]");
+}
+
+template <typename Mode>
+static void Run(const char* name, uint64_t bytes, Mode mode)
+{
+    ResetPeakRSS();
+    uint64_t allocations = g_allocations.load();
+    auto start = std::chrono::steady_clock::now();
+    ModeResult result = mode();
+    auto end = std::chrono::steady_clock::now();
+    Report(name, result, std::chrono::duration<double>(end - start).count(), bytes,
+           g_allocations.load() - allocations, PeakRSSKB());
+}
+
+static ModeResult ParseWithCallbacks(FLVParser& parser, uint64_t& tags)
+{
+    ModeResult result;
+    result._bOk = parser.Parse();
+    result._tags = tags;
+    return result;
+}
+
+static uint64_t ParseSize(const char* text)
+{
+    char* end = nullptr;
+    double value = strtod(text, &end);
+    switch (end ? *end : 0)
+    {
+    case 'k': case 'K':
+        return (uint64_t)(value * 1024);
+    case 'g': case 'G':
+        return (uint64_t)(value * 1024 * 1024 * 1024);
+    case 'm': case 'M':
+    default:
+        return (uint64_t)(value * 1024 * 1024);
+    }
+}
+
+static void ParseRange(const char* text, uint32_t& low, uint32_t& high)
+{
+    low = high = atoi(text);
+    const char* colon = strchr(text, ':');
+    if (colon)
+        high = atoi(colon + 1);
+}
+
+static void Usage()
+{
+    std::cerr << "[Usage]: bench_parse [options] file.flv\n"
+                 "  -s size        synthetic file size, K/M/G suffix (default 256M)\n"
+                 "  -r seed        generator seed (default 1)\n"
+                 "  -f fps         video frame rate, 0 disables video (default 30)\n"
+                 "  -g frames      GOP length (default 60)\n"
+                 "  -v min:max     inter frame payload bytes (default 2000:20000)\n"
+                 "  -k bytes       keyframe payload bytes (default 100000)\n"
+                 "  -a rate        audio tags per second, 0 disables audio (default 43)\n"
+                 "  -A min:max     audio payload bytes (default 200:400)\n"
+                 "  -m bytes       onMetaData size (default 512)\n"
+                 "  -i             add the onMetaData keyframes index\n"
+                 "  -x             reuse an existing file instead of generating it\n"
+                 "  -n             only generate the file\n"
+                 "  -M size        largest file parsed from memory (default 1G)" << std::endl;
+}
+
+int main(int argc, char* argv[])
+{
+    GeneratorOptions options;
+    bool bReuse = false;
+    bool bGenerateOnly = false;
+    uint64_t memoryLimit = 1ull << 30;
+    int opt;
+    while ((opt = getopt(argc, argv, "s:r:f:g:v:k:a:A:m:ixnM:h")) != -1)
+    {
+        switch (opt)
+        {
+        case 's': options._targetBytes = ParseSize(optarg); break;
+        case 'r': options._seed = atoi(optarg); break;
+        case 'f': options._fps = atoi(optarg); break;
+        case 'g': options._gopLength = atoi(optarg); break;
+        case 'v': ParseRange(optarg, options._videoMinBytes, options._videoMaxBytes); break;
+        case 'k': options._keyframeBytes = atoi(optarg); break;
+        case 'a': options._audioTagsPerSecond = atoi(optarg); break;
+        case 'A': ParseRange(optarg, options._audioMinBytes, options._audioMaxBytes); break;
+        case 'm': options._metadataBytes = atoi(optarg); break;
+        case 'i': options._bKeyframeIndex = true; break;
+        case 'x': bReuse = true; break;
+        case 'n': bGenerateOnly = true; break;
+        case 'M': memoryLimit = ParseSize(optarg); break;
+        default:
+            Usage();
+            return 1;
+        }
+    }
+    if (optind != argc - 1)
+    {
+        Usage();
+        return 1;
+    }
+    const char* path = argv[optind];
+
+    if (!bReuse || access(path, R_OK) != 0)
+    {
+        GeneratorResult generated;
+        auto start = std::chrono::steady_clock::now();
+        if (!GenerateFLV(path, options, &generated))
+            return 1;
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        printf("generated %s: %llu bytes, %llu tags (%llu video, %llu audio, %llu keyframes), %u ms, %.1f s\n",
+               path, (unsigned long long)generated._bytes, (unsigned long long)generated._tags,
+               (unsigned long long)generated._videoTags, (unsigned long long)generated._audioTags,
+               (unsigned long long)generated._keyframes, generated._durationMs, seconds);
+    }
+    if (bGenerateOnly)
+        return 0;
+
+    try
+    {
+        uint64_t bytes = 0;
+        {
+            FileReader probe(path);
+            bytes = probe.FileSize();
+        }
+
+        printf("%-22s %10s %14s %10s %10s %10s\n", "mode", "tags", "tags/s", "MB/s", "allocs/tag", "peakRSS KB");
+        ReadBackend backends[] = { ReadBackendIoUring, ReadBackendPread };
+        const char* names[] = { "callbacks/io_uring", "callbacks/pread" };
+        for (int idx = 0; idx < 2; idx++)
+        {
+            Run(names[idx], bytes, [&]()
+            {
+                ReadOptions readOptions;
+                readOptions._backend = backends[idx];
+                uint64_t tags = 0;
+                FLVParser parser(path, readOptions,
+                                 [&](FLVHeader*, uint32_t) {},
+                                 [&](FLVTag*, int, uint32_t, AVCPacket::AVCPacketHeader*, uint8_t) { tags++; },
+                                 [&](FLVTag*, int, uint32_t, uint8_t) { tags++; },
+                                 [&](FLVTag*, int, uint32_t) { tags++; });
+                return ParseWithCallbacks(parser, tags);
+            });
+        }
+
+        Run("callbacks/64K budget", bytes, [&]()
+        {
+            uint64_t tags = 0;
+            FLVParser parser(path,
+                             [&](FLVHeader*, uint32_t) {},
+                             [&](FLVTag*, int, uint32_t, AVCPacket::AVCPacketHeader*, uint8_t) { tags++; },
+                             [&](FLVTag*, int, uint32_t, uint8_t) { tags++; },
+                             [&](FLVTag*, int, uint32_t) { tags++; });
+            MemoryBudget budget;
+            budget._maxTagBytes = budget._chunkBytes = 64 << 10;
+            parser.SetMemoryBudget(budget, [&](const TagView& view, uint32_t offset, uint32_t payloadSize)
+            {
+                if (offset + view._dataSize == payloadSize)
+                    tags++;
+            });
+            return ParseWithCallbacks(parser, tags);
+        });
+
+        Run("pull", bytes, [&]()
+        {
+            FLVParser parser(path);
+            ModeResult result;
+            for (const TagView& tag : parser.Tags())
+            {
+                (void)tag;
+                result._tags++;
+            }
+            result._bOk = !parser.Failed();
+            return result;
+        });
+
+        Run("pipelined", bytes, [&]()
+        {
+            uint64_t tags = 0;
+            FLVParser parser(path,
+                             [&](FLVHeader*, uint32_t) {},
+                             [&](FLVTag*, int, uint32_t, AVCPacket::AVCPacketHeader*, uint8_t) { tags++; },
+                             [&](FLVTag*, int, uint32_t, uint8_t) { tags++; },
+                             [&](FLVTag*, int, uint32_t) { tags++; });
+            ModeResult result;
+            result._bOk = parser.ParsePipelined();
+            result._tags = tags;
+            return result;
+        });
+
+        // small pread blocks let the skips turn into real seeks
+        const char* keyframeNames[] = { "keyframes/walk", "keyframes/10s index" };
+        for (int idx = 0; idx < 2; idx++)
+        {
+            Run(keyframeNames[idx], bytes, [&]()
+            {
+                ReadOptions readOptions;
+                readOptions._backend = ReadBackendPread;
+                readOptions._blockSize = 64 << 10;
+                uint64_t tags = 0;
+                FLVParser parser(path, readOptions,
+                                 [&](FLVHeader*, uint32_t) {},
+                                 [&](FLVTag*, int, uint32_t, AVCPacket::AVCPacketHeader*, uint8_t) { tags++; });
+                KeyframeOptions options;
+                options._intervalMs = idx ? 10000 : 0;
+                options._bUseIndex = idx == 1;
+                parser.SetKeyframeOnly(true, options);
+                return ParseWithCallbacks(parser, tags);
+            });
+        }
+
+        Run("filter/audio 60-120s", bytes, [&]()
+        {
+            ReadOptions readOptions;
+            readOptions._backend = ReadBackendPread;
+            readOptions._blockSize = 64 << 10;
+            uint64_t tags = 0;
+            FLVParser parser(path, readOptions,
+                             [&](FLVHeader*, uint32_t) {},
+                             [&](FLVTag*, int, uint32_t, AVCPacket::AVCPacketHeader*, uint8_t) { tags++; },
+                             [&](FLVTag*, int, uint32_t, uint8_t) { tags++; },
+                             [&](FLVTag*, int, uint32_t) { tags++; });
+            TagFilter filter;
+            filter._bVideo = filter._bScript = false;
+            filter._startMs = 60000;
+            filter._endMs = 120000;
+            parser.SetTagFilter(true, filter);
+            return ParseWithCallbacks(parser, tags);
+        });
+
+        if (bytes <= memoryLimit)
+        {
+            std::vector<uint8_t> buffer(bytes);
+            {
+                FileReader reader(path);
+                buffer.resize(reader.Read(buffer.data(), buffer.size()));
+            }
+            Run("callbacks/memory", bytes, [&]()
+            {
+                uint64_t tags = 0;
+                MemorySource source(buffer.data(), buffer.size());
+                FLVParser parser(&source,
+                                 [&](FLVHeader*, uint32_t) {},
+                                 [&](FLVTag*, int, uint32_t, AVCPacket::AVCPacketHeader*, uint8_t) { tags++; },
+                                 [&](FLVTag*, int, uint32_t, uint8_t) { tags++; },
+                                 [&](FLVTag*, int, uint32_t) { tags++; });
+                return ParseWithCallbacks(parser, tags);
+            });
+        }
+
+        Run("validator", bytes, [&]()
+        {
+            FLVValidator validator(path);
+            ModeResult result;
+            result._bOk = validator.Validate();
+            result._tags = validator.Tags();
+            return result;
+        });
+
+        ChecksumType checksums[] = { ChecksumCrc32c, ChecksumXXHash64 };
+        const char* checksumNames[] = { "checksum/crc32c", "checksum/xxhash64" };
+        for (int idx = 0; idx < 2; idx++)
+        {
+            Run(checksumNames[idx], bytes, [&]()
+            {
+                ModeResult result;
+                FileReader file(path);
+                ChecksumSource source(&file, checksums[idx]);
+                TagChecksummer checksummer(checksums[idx],
+                                           [&](const FLVTag*, int, uint64_t) { result._tags++; });
+                FLVParser parser(&source, &DoNothingOnFLVHeader, checksummer.VideoTagHandler(),
+                                 checksummer.AudioTagHandler(), checksummer.ScriptTagHandler());
+                result._bOk = parser.Parse();
+                checksummer.Finish();
+                return result;
+            });
+        }
+
+        Run("stats", bytes, [&]()
+        {
+            StreamAnalyzer analyzer;
+            FLVParser parser(path, &DoNothingOnFLVHeader,
+                             analyzer.VideoTagHandler(), analyzer.AudioTagHandler());
+            ModeResult result;
+            result._bOk = parser.Parse();
+            StreamStats stats = analyzer.Result();
+            result._tags = stats._audio._tags + stats._video._tags;
+            return result;
+        });
+    }
+    catch (char const*)
+    {
+        std::cerr << "FLVParser init failed!" << std::endl;
+        return 1;
+    }
+    return 0;
+}
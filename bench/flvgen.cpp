@@ -0,0 +1,367 @@
+/**
+* This file is part of FLVParser.
+
+* FLVParser is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+
+* FLVParser is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+
+* You should have received a copy of the GNU General Public License
+* along with FLVParser.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "flvgen.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+FLVPARSER_NAMESPACE_BEGIN
+
+static const uint8_t kAVCDecoderConfiguration[] =
+{
+    0x01, 0x64, 0x00, 0x1f, 0xff, 0xe1, 0x00, 0x19,
+    0x67, 0x64, 0x00, 0x1f, 0xac, 0xd9, 0x40, 0x50,
+    0x05, 0xbb, 0x01, 0x10, 0x00, 0x00, 0x03, 0x00,
+    0x10, 0x00, 0x00, 0x03, 0x03, 0xc0, 0xf1, 0x83,
+    0x19, 0x60, 0x01, 0x00, 0x06, 0x68, 0xeb, 0xe3,
+    0xcb, 0x22, 0xc0
+};
+
+static const uint8_t kAACAudioSpecificConfig[] = { 0x12, 0x10 };
+
+static const size_t kPayloadPoolSize = 1 << 20;
+
+// xorshift64*, identical output on every platform
+class Random
+{
+public:
+    explicit Random(uint64_t seed) : _state(seed * 0x9E3779B97F4A7C15ull + 1) {}
+
+    uint64_t Next()
+    {
+        _state ^= _state >> 12;
+        _state ^= _state << 25;
+        _state ^= _state >> 27;
+        return _state * 0x2545F4914F6CDD1Dull;
+    }
+
+    uint32_t Range(uint32_t low, uint32_t high)
+    {
+        if (high <= low)
+            return low;
+        return low + (uint32_t)(Next() % (high - low + 1));
+    }
+
+private:
+    uint64_t    _state;
+};
+
+struct GeneratedTag
+{
+    uint8_t     _type;
+    uint32_t    _timestamp;
+    uint32_t    _dataSize;
+    bool        _bKey;
+    bool        _bSequenceHeader;
+};
+
+// Produces the tags in file order, sizes only, so the layout can be
+// computed before anything is written
+class TagSequence
+{
+public:
+    explicit TagSequence(const GeneratorOptions& options)
+        : _options(options), _random(options._seed) {}
+
+    GeneratedTag Next()
+    {
+        GeneratedTag tag = { 0, 0, 0, false, false };
+        if (_options._fps && !_bVideoHeader)
+        {
+            _bVideoHeader = true;
+            tag._type = 9;
+            tag._dataSize = 5 + sizeof(kAVCDecoderConfiguration);
+            tag._bKey = tag._bSequenceHeader = true;
+            return tag;
+        }
+        if (_options._audioTagsPerSecond && !_bAudioHeader)
+        {
+            _bAudioHeader = true;
+            tag._type = 8;
+            tag._dataSize = 2 + sizeof(kAACAudioSpecificConfig);
+            tag._bSequenceHeader = true;
+            return tag;
+        }
+        uint64_t videoTime = _options._fps ? _frames * 1000 / _options._fps : ~0ull;
+        uint64_t audioTime = _options._audioTagsPerSecond ?
+            _audioFrames * 1000 / _options._audioTagsPerSecond : ~0ull;
+        if (videoTime <= audioTime)
+        {
+            tag._type = 9;
+            tag._timestamp = (uint32_t)videoTime;
+            tag._bKey = _options._gopLength == 0 || _frames % _options._gopLength == 0;
+            uint32_t frameSize = tag._bKey ? _options._keyframeBytes :
+                _random.Range(_options._videoMinBytes, _options._videoMaxBytes);
+            // VideoTagHeader, AVCPacketHeader, NALU length and NALU header
+            tag._dataSize = 5 + 4 + 1 + frameSize;
+            _frames++;
+        }
+        else
+        {
+            tag._type = 8;
+            tag._timestamp = (uint32_t)audioTime;
+            tag._dataSize = 2 + _random.Range(_options._audioMinBytes, _options._audioMaxBytes);
+            _audioFrames++;
+        }
+        return tag;
+    }
+
+private:
+    GeneratorOptions    _options;
+    Random              _random;
+    uint64_t            _frames         { 0 };
+    uint64_t            _audioFrames    { 0 };
+    bool                _bVideoHeader   { false };
+    bool                _bAudioHeader   { false };
+};
+
+static void PutUInt16(std::string& out, uint32_t value)
+{
+    out += (char)(value >> 8);
+    out += (char)value;
+}
+
+static void PutUInt32(std::string& out, uint32_t value)
+{
+    PutUInt16(out, value >> 16);
+    PutUInt16(out, value);
+}
+
+static void PutKey(std::string& out, const char* key)
+{
+    PutUInt16(out, strlen(key));
+    out += key;
+}
+
+static void PutNumber(std::string& out, double value)
+{
+    uint64_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    out += (char)0x00;
+    PutUInt32(out, (uint32_t)(bits >> 32));
+    PutUInt32(out, (uint32_t)bits);
+}
+
+static void PutNumberArray(std::string& out, const std::vector<double>& values)
+{
+    out += (char)0x0A;
+    PutUInt32(out, values.size());
+    for (size_t idx = 0; idx < values.size(); idx++)
+        PutNumber(out, values[idx]);
+}
+
+static std::string BuildMetadata(const GeneratorOptions& options, double durationMs, double fileSize,
+                                 const std::vector<double>& positions, const std::vector<double>& times)
+{
+    std::string body;
+    uint32_t count = 0;
+    PutKey(body, "duration");       PutNumber(body, durationMs / 1000.0);     count++;
+    PutKey(body, "filesize");       PutNumber(body, fileSize);                count++;
+    if (options._fps)
+    {
+        PutKey(body, "width");          PutNumber(body, 1280);                count++;
+        PutKey(body, "height");         PutNumber(body, 720);                 count++;
+        PutKey(body, "framerate");      PutNumber(body, options._fps);        count++;
+        PutKey(body, "videocodecid");   PutNumber(body, 7);                   count++;
+    }
+    if (options._audioTagsPerSecond)
+    {
+        PutKey(body, "audiocodecid");   PutNumber(body, 10);                  count++;
+    }
+    if (options._bKeyframeIndex)
+    {
+        PutKey(body, "keyframes");
+        body += (char)0x03;
+        PutKey(body, "filepositions");
+        PutNumberArray(body, positions);
+        PutKey(body, "times");
+        PutNumberArray(body, times);
+        body += std::string("\x00\x00\x09", 3);
+        count++;
+    }
+
+    // "onMetaData" string, ECMA array header, end marker
+    size_t fixed = 1 + 2 + 10 + 1 + 4 + 3;
+    size_t padKey = 2 + 7;
+    if (fixed + body.size() + padKey + 3 <= options._metadataBytes)
+    {
+        size_t pad = options._metadataBytes - fixed - body.size() - padKey;
+        PutKey(body, "padding");
+        if (pad - 3 <= 0xFFFF)
+        {
+            body += (char)0x02;
+            PutUInt16(body, pad - 3);
+            body.append(pad - 3, 'x');
+        }
+        else
+        {
+            body += (char)0x0C;
+            PutUInt32(body, pad - 5);
+            body.append(pad - 5, 'x');
+        }
+        count++;
+    }
+
+    std::string out;
+    out += (char)0x02;
+    PutKey(out, "onMetaData");
+    out += (char)0x08;
+    PutUInt32(out, count);
+    out += body;
+    out += std::string("\x00\x00\x09", 3);
+    return out;
+}
+
+static void PutTagHeader(std::string& out, uint8_t type, uint32_t dataSize, uint32_t timestamp)
+{
+    out += (char)type;
+    out += (char)(dataSize >> 16);
+    PutUInt16(out, dataSize);
+    out += (char)(timestamp >> 16);
+    PutUInt16(out, timestamp);
+    out += (char)(timestamp >> 24);
+    out.append(3, '\0');
+}
+
+bool GenerateFLV(const char* path, const GeneratorOptions& options, GeneratorResult* result)
+{
+    // first pass: layout, duration and keyframe positions
+    std::vector<double> positions;
+    std::vector<double> times;
+    uint64_t bodyBytes = 0;
+    uint32_t durationMs = 0;
+    uint64_t tags = 0;
+    {
+        TagSequence sequence(options);
+        while (bodyBytes + 13 + options._metadataBytes < options._targetBytes || tags < 2)
+        {
+            GeneratedTag tag = sequence.Next();
+            if (tag._type == 9 && tag._bKey && !tag._bSequenceHeader)
+            {
+                positions.push_back((double)bodyBytes);
+                times.push_back(tag._timestamp / 1000.0);
+            }
+            bodyBytes += 11 + tag._dataSize + 4;
+            if (tag._timestamp > durationMs)
+                durationMs = tag._timestamp;
+            tags++;
+        }
+    }
+    std::string metadata = BuildMetadata(options, durationMs, 0, positions, times);
+    uint64_t bodyStart = 9 + 4 + 11 + metadata.size() + 4;
+    for (size_t idx = 0; idx < positions.size(); idx++)
+        positions[idx] += bodyStart;
+    metadata = BuildMetadata(options, durationMs, bodyStart + bodyBytes, positions, times);
+
+    FILE* file = fopen(path, "wb");
+    if (!file)
+    {
+        std::cerr << "[failed]: could not create " << path << std::endl;
+        return false;
+    }
+    std::vector<char> fileBuffer(4 << 20);
+    setvbuf(file, fileBuffer.data(), _IOFBF, fileBuffer.size());
+
+    std::vector<uint8_t> pool(kPayloadPoolSize);
+    Random random(options._seed ^ 0x5bd1e995u);
+    for (size_t idx = 0; idx < pool.size(); idx += 8)
+    {
+        uint64_t value = random.Next();
+        memcpy(&pool[idx], &value, 8);
+    }
+
+    std::string head("FLV\x01", 4);
+    head += (char)((options._fps ? 0x01 : 0) | (options._audioTagsPerSecond ? 0x04 : 0));
+    PutUInt32(head, 9);
+    PutUInt32(head, 0);
+    PutTagHeader(head, 18, metadata.size(), 0);
+    head += metadata;
+    PutUInt32(head, 11 + metadata.size());
+    bool bOk = fwrite(head.data(), head.size(), 1, file) == 1;
+
+    GeneratorResult stats;
+    stats._bytes = head.size();
+    stats._durationMs = durationMs;
+    stats._tags = 1;
+    TagSequence sequence(options);
+    std::string prefix;
+    for (uint64_t idx = 0; idx < tags && bOk; idx++)
+    {
+        GeneratedTag tag = sequence.Next();
+        prefix.clear();
+        PutTagHeader(prefix, tag._type, tag._dataSize, tag._timestamp);
+        uint32_t bodySize = 0;
+        if (tag._type == 9)
+        {
+            stats._videoTags++;
+            prefix += (char)(tag._bKey ? 0x17 : 0x27);
+            if (tag._bSequenceHeader)
+            {
+                prefix += std::string("\x00\x00\x00\x00", 4);
+                prefix.append((const char*)kAVCDecoderConfiguration, sizeof(kAVCDecoderConfiguration));
+            }
+            else
+            {
+                stats._keyframes += tag._bKey;
+                prefix += std::string("\x01\x00\x00\x00", 4);
+                PutUInt32(prefix, tag._dataSize - 9);
+                prefix += (char)(tag._bKey ? 0x65 : 0x41);
+                bodySize = tag._dataSize - 10;
+            }
+        }
+        else
+        {
+            stats._audioTags++;
+            prefix += (char)0xAF;
+            if (tag._bSequenceHeader)
+            {
+                prefix += (char)0x00;
+                prefix.append((const char*)kAACAudioSpecificConfig, sizeof(kAACAudioSpecificConfig));
+            }
+            else
+            {
+                prefix += (char)0x01;
+                bodySize = tag._dataSize - 2;
+            }
+        }
+        bOk = fwrite(prefix.data(), prefix.size(), 1, file) == 1;
+        while (bOk && bodySize > 0)
+        {
+            uint32_t n = bodySize < kPayloadPoolSize / 2 ? bodySize : kPayloadPoolSize / 2;
+            size_t start = (size_t)(random.Next() % (kPayloadPoolSize / 2));
+            bOk = fwrite(&pool[start], n, 1, file) == 1;
+            bodySize -= n;
+        }
+        std::string previousTagSize;
+        PutUInt32(previousTagSize, 11 + tag._dataSize);
+        bOk = bOk && fwrite(previousTagSize.data(), 4, 1, file) == 1;
+        stats._bytes += 11 + tag._dataSize + 4;
+        stats._tags++;
+    }
+    if (fclose(file) != 0)
+        bOk = false;
+    if (!bOk)
+        std::cerr << "[failed]: writing " << path << " failed" << std::endl;
+    if (result)
+        *result = stats;
+    return bOk;
+}
+
+FLVPARSER_NAMESPACE_END
@@ -0,0 +1,57 @@
+/**
+* This file is part of FLVParser.
+
+* FLVParser is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+
+* FLVParser is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+
+* You should have received a copy of the GNU General Public License
+* along with FLVParser.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef FLVGEN_H_
+#define FLVGEN_H_
+
+#include "../api/common.h"
+
+FLVPARSER_NAMESPACE_BEGIN
+
+// Deterministic synthetic FLV stream: AVC video and AAC audio tags with
+// pseudo random payload sizes, the same options always give the same bytes
+struct GeneratorOptions
+{
+    uint64_t    _targetBytes        { 256ull << 20 };   //!< Approximate file size
+    uint32_t    _seed               { 1 };
+    uint32_t    _fps                { 30 };             //!< 0 disables video
+    uint32_t    _gopLength          { 60 };             //!< Frames per GOP
+    uint32_t    _videoMinBytes      { 2000 };           //!< Inter frame payload range
+    uint32_t    _videoMaxBytes      { 20000 };
+    uint32_t    _keyframeBytes      { 100000 };
+    uint32_t    _audioTagsPerSecond { 43 };             //!< 0 disables audio
+    uint32_t    _audioMinBytes      { 200 };
+    uint32_t    _audioMaxBytes      { 400 };
+    uint32_t    _metadataBytes      { 512 };            //!< onMetaData is padded up to this size
+    bool        _bKeyframeIndex     { false };          //!< Add the onMetaData keyframes object
+};
+
+struct GeneratorResult
+{
+    uint64_t    _bytes              { 0 };
+    uint64_t    _tags               { 0 };
+    uint64_t    _videoTags          { 0 };
+    uint64_t    _audioTags          { 0 };
+    uint64_t    _keyframes          { 0 };
+    uint32_t    _durationMs         { 0 };
+};
+
+bool GenerateFLV(const char* path, const GeneratorOptions& options, GeneratorResult* result = nullptr);
+
+FLVPARSER_NAMESPACE_END
+
+#endif // FLVGEN_H_
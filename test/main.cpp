@@ -17,6 +17,10 @@
 
 #include "../api/flvparser.h"
 
+#include <memory>
+#include <string.h>
+#include <unistd.h>
+
 using namespace flvparser;
 
 void PrintFLVHeader(FLVHeader* header, uint32_t preSize)
@@ -69,12 +73,18 @@ int main(int argc, const char* argv[])
     int retCode = 0;
     if (argc != 2)
     {
-        std::cerr << "[Usage]: flvparser inputfile" << std::endl;
+        std::cerr << "[Usage]: flvparser inputfile (- reads from stdin)" << std::endl;
         return 1;
     }
     try
     {
-        FLVParser parser(argv[1],
+        // "-" parses the flv stream from a pipe
+        std::unique_ptr<ByteSource> source;
+        if (strcmp(argv[1], "-") == 0)
+            source.reset(new FdSource(STDIN_FILENO));
+        else
+            source.reset(new FileReader(argv[1]));
+        FLVParser parser(source.get(),
                          &PrintFLVHeader,
                          &PrintVideoTag,
                          &PrintAudioTag,
@@ -0,0 +1,107 @@
+/**
+* This file is part of FLVParser.
+
+* FLVParser is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+
+* FLVParser is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+
+* You should have received a copy of the GNU General Public License
+* along with FLVParser.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "../api/flvcatalog.h"
+
+#include <chrono>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+using namespace flvparser;
+
+static void Usage()
+{
+    std::cerr << "[Usage]: flvcatalog [options] catalog.bin directory...\n"
+                 "  -j threads     scan threads (default every hardware thread)\n"
+                 "  -e extension   file extension to catalog (default .flv, \"\" for every file)\n"
+                 "  -L             follow symbolic links\n"
+                 "  -l             list the catalog after the update" << std::endl;
+}
+
+int main(int argc, char* argv[])
+{
+    CatalogOptions options;
+    bool bList = false;
+    int opt;
+    while ((opt = getopt(argc, argv, "j:e:Llh")) != -1)
+    {
+        switch (opt)
+        {
+        case 'j': options._threads = atoi(optarg); break;
+        case 'e': options._extension = *optarg ? optarg : nullptr; break;
+        case 'L': options._bFollowSymlinks = true; break;
+        case 'l': bList = true; break;
+        default:
+            Usage();
+            return 1;
+        }
+    }
+    if (argc - optind < 1)
+    {
+        Usage();
+        return 1;
+    }
+    try
+    {
+        FLVCatalog catalog(argv[optind]);
+        for (int idx = optind + 1; idx < argc; idx++)
+        {
+            auto start = std::chrono::steady_clock::now();
+            if (!catalog.Update(argv[idx], options))
+                return 1;
+            double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            const CatalogUpdate& update = catalog.LastUpdate();
+            printf("%s: %llu directories, %llu files, %llu parsed, %llu reused, %llu removed, "
+                   "%llu failed in %.3f s\n", argv[idx],
+                   (unsigned long long)update._directories, (unsigned long long)update._files,
+                   (unsigned long long)update._parsed, (unsigned long long)update._reused,
+                   (unsigned long long)update._removed, (unsigned long long)update._failed, seconds);
+        }
+        if (optind + 1 < argc && !catalog.Save())
+            return 1;
+        if (bList)
+        {
+            for (const CatalogEntry& entry : catalog.Entries())
+            {
+                printf("%s: %s%s%s%s tags %llu keyframes %u duration %u ms",
+                       entry._path.c_str(), entry._bValid ? "" : "invalid ",
+                       entry._bTruncated ? "truncated " : "",
+                       entry._bHasVideo ? "V" : "", entry._bHasAudio ? "A" : "",
+                       (unsigned long long)entry._tags, entry._keyframes, entry._durationMs);
+                if (entry._videoCodec != kCatalogNoCodec)
+                    printf(" video %u", entry._videoCodec);
+                if (entry._videoFourCC)
+                    printf(" video %c%c%c%c", (char)(entry._videoFourCC >> 24), (char)(entry._videoFourCC >> 16),
+                           (char)(entry._videoFourCC >> 8), (char)entry._videoFourCC);
+                if (entry._audioCodec != kCatalogNoCodec)
+                    printf(" audio %u", entry._audioCodec);
+                if (entry._width > 0)
+                    printf(" %.0fx%.0f", entry._width, entry._height);
+                if (entry._frameRate > 0)
+                    printf(" %.2f fps", entry._frameRate);
+                printf("\n");
+            }
+        }
+    }
+    catch (char const*)
+    {
+        std::cerr << "FLVCatalog init failed!" << std::endl;
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,80 @@
+/**
+* This file is part of FLVParser.
+
+* FLVParser is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+
+* FLVParser is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+
+* You should have received a copy of the GNU General Public License
+* along with FLVParser.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "../api/flvinterleave.h"
+
+#include <chrono>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+using namespace flvparser;
+
+static void Usage()
+{
+    std::cerr << "[Usage]: flvinterleave [options] input.flv output.flv\n"
+                 "  -w ms          reorder window in milliseconds (default 5000)\n"
+                 "  -t tags        most tags held back (default 65536)\n"
+                 "  -b bytes       most payload bytes held back (default 268435456)" << std::endl;
+}
+
+int main(int argc, char* argv[])
+{
+    InterleaveOptions options;
+    int opt;
+    while ((opt = getopt(argc, argv, "w:t:b:h")) != -1)
+    {
+        switch (opt)
+        {
+        case 'w': options._windowMs = atoi(optarg); break;
+        case 't': options._maxTags = atoi(optarg); break;
+        case 'b': options._maxBytes = strtoull(optarg, nullptr, 10); break;
+        default:
+            Usage();
+            return 1;
+        }
+    }
+    if (argc - optind != 2)
+    {
+        Usage();
+        return 1;
+    }
+    try
+    {
+        auto start = std::chrono::steady_clock::now();
+        FLVInterleaver interleaver(argv[optind + 1], options);
+        if (!interleaver.Interleave(argv[optind]))
+            return 1;
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        InterleaveResult result = interleaver.Result();
+        printf("%llu tags, %llu reordered, %llu still late, window needed %u ms, "
+               "held at most %u tags / %llu bytes, %llu bytes in %llu writes, %.1f MB/s\n",
+               (unsigned long long)result._tags, (unsigned long long)result._reordered,
+               (unsigned long long)result._lateTags, result._neededMs, result._maxHeldTags,
+               (unsigned long long)result._maxHeldBytes, (unsigned long long)result._bytes,
+               (unsigned long long)result._writeCalls,
+               seconds > 0 ? result._bytes / seconds / (1024 * 1024) : 0.0);
+        if (result._lateTags)
+            std::cerr << "[warning]: the window was too small, run again with -w " << result._neededMs << std::endl;
+    }
+    catch (char const*)
+    {
+        std::cerr << "FLVInterleaver init failed!" << std::endl;
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,76 @@
+/**
+* This file is part of FLVParser.
+
+* FLVParser is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+
+* FLVParser is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+
+* You should have received a copy of the GNU General Public License
+* along with FLVParser.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "../api/flvremux.h"
+
+#include <chrono>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+using namespace flvparser;
+
+static void Usage()
+{
+    std::cerr << "[Usage]: flvremux [options] input.flv output.mp4\n"
+                 "  -f ms          shortest fragment, cut at the next keyframe (default every GOP)\n"
+                 "  -w bytes       read window, longer fragments are cut early (default 67108864)" << std::endl;
+}
+
+int main(int argc, char* argv[])
+{
+    RemuxOptions options;
+    int opt;
+    while ((opt = getopt(argc, argv, "f:w:h")) != -1)
+    {
+        switch (opt)
+        {
+        case 'f': options._fragmentMs = atoi(optarg); break;
+        case 'w': options._maxFragmentBytes = strtoull(optarg, nullptr, 10); break;
+        default:
+            Usage();
+            return 1;
+        }
+    }
+    if (argc - optind != 2)
+    {
+        Usage();
+        return 1;
+    }
+    try
+    {
+        auto start = std::chrono::steady_clock::now();
+        FMP4Remuxer remuxer(argv[optind + 1], options);
+        if (!remuxer.Remux(argv[optind]))
+            return 1;
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        RemuxResult result = remuxer.Result();
+        printf("%u fragments, %llu video and %llu audio samples, %llu tags dropped, %ux%u, %u Hz %u channels, "
+               "%llu bytes in %llu writes, %.1f MB/s\n",
+               result._fragments, (unsigned long long)result._videoSamples,
+               (unsigned long long)result._audioSamples, (unsigned long long)result._droppedTags,
+               result._width, result._height, result._sampleRate, result._channels,
+               (unsigned long long)result._bytes, (unsigned long long)result._writeCalls,
+               seconds > 0 ? result._bytes / seconds / (1024 * 1024) : 0.0);
+    }
+    catch (char const*)
+    {
+        std::cerr << "FMP4Remuxer init failed!" << std::endl;
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,82 @@
+/**
+* This file is part of FLVParser.
+
+* FLVParser is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+
+* FLVParser is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+
+* You should have received a copy of the GNU General Public License
+* along with FLVParser.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "../api/flvsplice.h"
+
+#include <chrono>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+using namespace flvparser;
+
+static void Usage()
+{
+    std::cerr << "[Usage]: flvsplice [options] output.flv segment.flv...\n"
+                 "  -k             keep repeated sequence headers\n"
+                 "  -m             keep every onMetaData instead of merging them\n"
+                 "  -c bytes       tags from this size on are copied in the kernel (default 262144)" << std::endl;
+}
+
+int main(int argc, char* argv[])
+{
+    SpliceOptions options;
+    int opt;
+    while ((opt = getopt(argc, argv, "kmc:h")) != -1)
+    {
+        switch (opt)
+        {
+        case 'k': options._bDropDuplicateHeaders = false; break;
+        case 'm': options._bMergeMetadata = false; break;
+        case 'c': options._copyThreshold = atoi(optarg); break;
+        default:
+            Usage();
+            return 1;
+        }
+    }
+    if (argc - optind < 2)
+    {
+        Usage();
+        return 1;
+    }
+    try
+    {
+        auto start = std::chrono::steady_clock::now();
+        FLVSplicer splicer(argv[optind], options);
+        for (int idx = optind + 1; idx < argc; idx++)
+        {
+            if (!splicer.Append(argv[idx]))
+                return 1;
+        }
+        if (!splicer.Finish())
+            return 1;
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        SpliceResult result = splicer.Result();
+        printf("%u segments, %llu tags, %llu bytes (%llu copied in kernel), %u ms, "
+               "%llu sequence headers and %llu onMetaData dropped, %.1f MB/s\n",
+               result._segments, (unsigned long long)result._tags, (unsigned long long)result._bytes,
+               (unsigned long long)result._kernelCopiedBytes, result._durationMs,
+               (unsigned long long)result._droppedHeaders, (unsigned long long)result._droppedMetadata,
+               seconds > 0 ? result._bytes / seconds / (1024 * 1024) : 0.0);
+    }
+    catch (char const*)
+    {
+        std::cerr << "FLVSplicer init failed!" << std::endl;
+        return 1;
+    }
+    return 0;
+}